@@ -0,0 +1,65 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include "board.h"
+
+#define AFFINITY_MAX_CPUS 1024      // CPUs a placement can name (CPU_SETSIZE on glibc)
+
+typedef enum {
+    AFFINITY_NONE = 0,  // threads go wherever the scheduler puts them
+    AFFINITY_COMPACT,   // consecutive slots on hyperthread siblings, then neighbouring cores, one package first
+    AFFINITY_SPREAD,    // one slot per physical core, alternating packages, before any sibling is reused
+    AFFINITY_LIST,      // the CPUs given, in order
+} affinity_policy_t;
+
+typedef enum {
+    AFFINITY_RENDER = 0,    // the main thread: input and drawing
+    AFFINITY_LOGGER,        // the debug.log flusher
+    AFFINITY_PACMAN,
+    AFFINITY_GHOST,
+} affinity_role_t;
+
+/*Sets the placement policy from 'spec': "none", "compact", "spread" or a CPU list such as
+"0,2,4-7". The CPUs come from the ones the process may run on (sched_getaffinity) and the
+order from /sys/devices/system/cpu/cpuN/topology, when readable. Set before the threads start.
+Returns -1 (keeping the old policy) when the spec does not parse or names a CPU the process
+cannot use*/
+int affinity_configure(const char* spec);
+
+/*The policy in force*/
+affinity_policy_t affinity_policy(void);
+
+/*Name of a policy, as accepted by affinity_configure ("list" for AFFINITY_LIST)*/
+const char* affinity_policy_name(affinity_policy_t policy);
+
+/*Slot of a thread in the placement order: render, logger, the 'n_pacmans' pacmans, then the
+ghosts. Slots wrap around when there are more threads than CPUs*/
+static inline int affinity_slot(affinity_role_t role, int index, int n_pacmans) {
+    switch (role) {
+        case AFFINITY_RENDER: return 0;
+        case AFFINITY_LOGGER: return 1;
+        case AFFINITY_PACMAN: return 2 + index;
+        default: return 2 + n_pacmans + index;
+    }
+}
+
+/*CPU of 'slot' under the policy in force, -1 with AFFINITY_NONE*/
+int affinity_cpu(int slot);
+
+/*Pins the calling thread to the CPU of 'slot'. Returns that CPU, or -1 when there is no policy
+or the kernel refused (then the thread keeps its mask and a warning is logged)*/
+int affinity_pin(int slot);
+
+/*Pins the calling thread as 'index'-th thread of 'role' on 'board' (n_pacmans taken from it)*/
+int affinity_pin_role(board_t* board, affinity_role_t role, int index);
+
+/*Gives the calling thread back every CPU the process could use when the policy was set*/
+void affinity_unpin(void);
+
+/*CPU the calling thread is running on right now, -1 if unknown*/
+int affinity_current_cpu(void);
+
+/*Writes the CPU order of the policy ("3 1 2 0 ...") into 'buf', shortened to fit*/
+void affinity_describe(char* buf, size_t size);
+
+#endif
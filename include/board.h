@@ -1,11 +1,19 @@
 #include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #ifndef BOARD_H
 #define BOARD_H
 
+#include "input_queue.h"
+#include "log.h"
+
 #define MAX_MOVES 20
 #define MAX_LEVELS 20
 #define MAX_FILENAME 256
 #define MAX_GHOSTS 25
+#define MAX_PACMANS 8
+#define MAX_PLAYERS 3       // pacmans that can be played from the keyboard at once, see pacman_for_key
+#define MAX_DELTA_HOOKS 4
 
 typedef enum {
     REACHED_PORTAL = 1,
@@ -14,23 +22,78 @@ typedef enum {
     DEAD_PACMAN = -2,
 } move_t;
 
+// Lifecycle of a round: it starts in GAME_RUNNING and the first transition out of it
+// is the reason the round ended
+typedef enum {
+    GAME_RUNNING = 0,
+    GAME_PORTAL_REACHED,
+    GAME_PACMAN_DEAD,
+    GAME_QUIT,
+    GAME_BACKUP_REQUESTED,
+    GAME_REWIND_REQUESTED,
+} game_state_t;
+
+// How alloc_board backs planes of at least one huge page (board->huge_pages)
+typedef enum {
+    HUGE_PAGES_OFF = 0,     // calloc
+    HUGE_PAGES_THP,         // anonymous mapping aligned to a huge page and madvise(MADV_HUGEPAGE)
+    HUGE_PAGES_HUGETLB,     // MAP_HUGETLB from the reserved pool, HUGE_PAGES_THP when it is empty
+} huge_pages_t;
+
 typedef struct {
     char command;
     int turns;
     int turns_left;
 } command_t;
 
+// Kinds of change reported to the delta hooks
+typedef enum {
+    DELTA_CELL = 1, // a cell changed content
+    DELTA_DOT,      // a dot was collected
+    DELTA_PACMAN,   // a pacman changed state (position, points, script cursor, alive)
+    DELTA_GHOST,    // a ghost changed state (position, script cursor, charged)
+} delta_kind_t;
+
+// Compact copy of the state of an agent that a single step can change
+typedef struct {
+    int32_t pos_x, pos_y;
+    int32_t points;         // pacman only
+    int32_t current_move;
+    int32_t waiting;
+    int16_t cmd_index;      // script command this step used, -1 for typed commands
+    int16_t cmd_turns_left; // turns_left of that command
+    uint8_t charged;        // ghost only
+    uint8_t alive;          // pacman only
+    uint8_t pad[2];
+    uint32_t rng;           // state of its 'R' generator
+} agent_state_t;
+
+// One change made by move_pacman/move_ghost/kill_pacman, with the values before and after
+// so it can be replayed (redo) or rewound (undo)
+typedef struct {
+    uint8_t kind;           // delta_kind_t
+    char old_cell, new_cell; // DELTA_CELL
+    uint32_t tick;          // board->tick when the change happened
+    int32_t index;          // cell index, or agent index for DELTA_PACMAN/DELTA_GHOST
+    agent_state_t before, after; // DELTA_PACMAN/DELTA_GHOST
+} board_delta_t;
+
+/*Called for every delta, from whichever agent thread made the change (must be thread-safe)*/
+typedef void (*delta_hook_t)(void* ctx, const board_delta_t* delta);
+
 typedef struct {
     int pos_x, pos_y; //current position
-    int alive; // if is alive
+    atomic_int alive; // if is alive
     int points; // how many points have been collected
     int passo; // number of plays to wait before starting
     command_t moves[MAX_MOVES];
     int current_move;
     int n_moves; // number of predefined moves, 0 if controlled by user, >0 if readed from level file
     int waiting;
+    int player; // keys of a pacman played from the keyboard (0 WASD, 1 IJKL, 2 8456), -1 when scripted
+    uint32_t rng; // xorshift32 state of its 'R' moves, see board_seed_agents
     pthread_t tid;
-    char next_direction;
+    input_queue_t input; // commands typed by the player, used when n_moves == 0
 } pacman_t;
 
 typedef struct {
@@ -41,34 +104,68 @@ typedef struct {
     int current_move;
     int waiting;
     int charged;
+    uint32_t rng; // xorshift32 state of its 'R' moves, see board_seed_agents
 
     pthread_t tid;
 } ghost_t;
 
-typedef struct {
-    char content;   // stuff like 'P' for pacman 'M' for monster/ghost and 'W' for wall
-    int has_dot;    // whether there is a dot in this position or not
-    int has_portal; // whether there is a portal in this position or not
-    pthread_mutex_t mutex;
-} board_pos_t;
-
 typedef struct {
     int width, height;      // dimensions of the board
-    board_pos_t* board;     // actual board, a row-major matrix
+    char* cells;            // actual board, a row-major matrix: 'P' for pacman, 'M' for monster/ghost, 'W' for wall, ' ' empty
+    pthread_mutex_t* locks; // one mutex per cell, same layout as cells
+    uint64_t* dots;         // bitset with one bit per cell, set while that cell still has a dot
+    uint64_t* portals;      // bitset with one bit per cell, set where there is a portal
+    int total_dots;         // dots present when the level was loaded
+    atomic_int dots_left;   // dots not yet collected, decremented by move_pacman
+    int win_on_clear;       // if set, collecting the last dot also finishes the level ("WIN DOTS")
     int n_pacmans;          // number of pacmans in the board
-    pacman_t* pacmans;      // array containing every pacman in the board to iterate through when processing (Just 1)
+    pacman_t* pacmans;      // array containing every pacman in the board to iterate through when processing
     int n_ghosts;           // number of ghosts in the board
     ghost_t* ghosts;        // array containing every ghost in the board to iterate through when processing
     char level_name[256];   //name for the level file to keep track of which will be the next
-    char pacman_file[256];  // file with pacman movements
+    char pacman_files[MAX_PACMANS][256]; // files with pacman movements, one per pacman
     char ghosts_files[MAX_GHOSTS][256]; // files with monster movements
     int tempo;              // Duration of each play         
+    uint64_t seed;          // session seed of the agents' 'R' generators, set before loading
     int current_board_line; // current line being processed when loading a level
     int board_line_count;   // total number of lines in the level being loaded
     int cnt_moves;          // number of moves
-    volatile int game_running; // flag to indicate if the game is running
+    int input_depth;        // commands each pacman input queue can buffer, 0 for the default
+    int profile_locks;      // if set, alloc_board also creates lock_profile
+    int huge_pages;         // huge_pages_t for the planes, set before loading
+    int planes_mapped;      // planes alloc_board mapped itself (bits in board.c), freed with munmap
+    int planes_hugetlb;     // of those, the ones that got MAP_HUGETLB pages
+    struct lock_profile* lock_profile; // wait/hold times of the locks per region, NULL unless profiling
+    int tile_owned;         // set while a tile simulation (tiles.h) steps the board: moves skip the cell mutexes
+    atomic_int state;       // game_state_t of the current round, see game_start/game_end
+    atomic_uint version;    // bumped on every visible change, lets the renderer skip unchanged frames
+    atomic_uint tick;       // steps of the round so far, advanced by the pacman thread
+    int n_delta_hooks;      // registered delta hooks, see add_delta_hook
+    delta_hook_t delta_hooks[MAX_DELTA_HOOKS];
+    void* delta_ctx[MAX_DELTA_HOOKS];
 } board_t;
 
+/*huge_pages_t named "off", "thp" or "hugetlb", -1 for anything else*/
+int parse_huge_pages(const char* name);
+
+/*Puts the board back in GAME_RUNNING before the agent threads are started*/
+void game_start(board_t* board);
+
+/*Ends the round with 'reason' if it is still running. Only the first call wins;
+returns 1 if this call ended the round*/
+int game_end(board_t* board, game_state_t reason);
+
+/*Current lifecycle state (acquire load, pairs with game_end)*/
+game_state_t game_state(board_t* board);
+
+/*Shorthand for game_state(board) == GAME_RUNNING*/
+int game_is_running(board_t* board);
+
+/*Sets board->seed and gives every agent its own 'R' generator, seeded from (seed, agent): pacman
+i is agent i, ghost i is agent MAX_PACMANS + i. Loading a level does it with board->seed, so the
+same session seed draws the same directions per agent whatever thread moves it*/
+void board_seed_agents(board_t* board, uint64_t seed);
+
 /*Makes the current thread sleep for 'int milliseconds' miliseconds*/
 void sleep_ms(int milliseconds);
 
@@ -78,14 +175,61 @@ command - command to be processed*/
 int move_pacman(board_t* board, int pacman_index, command_t* command);
 int move_ghost(board_t* board, int ghost_index, command_t* command);
 
-/*Process the death of a Pacman*/
+/*One tick of the game on the calling thread, in a fixed order: every pacman moves in index order
+(its script, or keys[i] when it is typed, '\0' for no key; 'keys' may be NULL), the tick
+advances and then every ghost moves while the round is running. Used instead of the agent
+threads by replays and the library*/
+void board_tick_keys(board_t* board, const char* keys);
+
+/*board_tick_keys with 'key' for pacman 0 and no key for the others*/
+void board_tick(board_t* board, char key);
+
+/*The first half of board_tick_keys: the pacman moves and the tick advance, for engines that step
+the ghosts their own way (tiles.h, swarm.h)*/
+void board_tick_pacmans(board_t* board, const char* keys);
+
+/*Finds the typed pacman whose player keys include 'key' (WASD, IJKL or 8456 for players 0-2) and
+stores the command it stands for in 'command'. Returns the pacman index, -1 if nobody uses 'key'*/
+int pacman_for_key(board_t* board, char key, char* command);
+
+/*The four keys of 'player' in the order up, left, down, right; NULL outside 0..MAX_PLAYERS-1*/
+const char* player_keys_of(int player);
+
+/*Index of the first pacman still alive, the one whose thread advances the tick; -1 if none*/
+int first_alive_pacman(board_t* board);
+
+/*Charged ghost move: slides in 'direction' until a wall or another ghost, killing a pacman in
+the way. Called by move_ghost for a ghost that is charged; does not report deltas*/
+int move_ghost_charged(board_t* board, int ghost_index, char direction);
+
+/*Returns 1 if the cell at 'index' still has a dot*/
+int board_has_dot(board_t* board, int index);
+
+/*Returns 1 if the cell at 'index' has a portal*/
+int board_has_portal(board_t* board, int index);
+
+/*Counts the dots still on the board (popcount over the dot bitset)*/
+int count_dots(board_t* board);
+
+/*Registers a hook that receives every change the agents make to the board.
+Only call while no agent thread is running. Returns -1 if all slots are taken*/
+int add_delta_hook(board_t* board, delta_hook_t hook, void* ctx);
+
+/*Removes a hook registered with add_delta_hook*/
+void remove_delta_hook(board_t* board, delta_hook_t hook, void* ctx);
+
+/*Applies a delta to the board (undo = 0) or reverts it (undo = 1). Agent threads must be stopped*/
+void apply_delta(board_t* board, const board_delta_t* delta, int undo);
+
+/*Process the death of a Pacman. The round ends (GAME_PACMAN_DEAD) when it was the last one alive*/
 void kill_pacman(board_t* board, int pacman_index);
 
 /*Adds a pacman to the board*/
 int load_pacman(board_t* board, int points);
 
-/*Loads pacman from file*/
-int load_pacman_file(board_t* board, const char* filepath, int points);
+/*Loads pacman 'pacman_index' from file. A script made of the single command KEYS is played from
+the keyboard instead*/
+int load_pacman_file(board_t* board, const char* filepath, int pacman_index, int points);
 
 /*Adds a ghost(monster) to the board*/
 int load_ghost(board_t* board);
@@ -108,18 +252,19 @@ char* parse_line(board_t *board, char *line);
 /*Unloads levels loaded by load_level*/
 void unload_level(board_t * board);
 
-// DEBUG FILE
-
-/*Opens the debug file*/
-void open_debug_file(char *filename);
+// DEBUG FILE (open_debug_file, debug, ... are in log.h)
 
-/*Closes the debug file*/
-void close_debug_file();
+#define DUMP_PLAIN 0        // one character per cell
+#define DUMP_RLE 1          // runs of 2+ equal cells written as the length and the cell ("W3 .2W")
+#define DUMP_CHUNK 4096     // bytes of rows formatted before each fwrite
 
-/*Writes to the open debug file*/
-void debug(const char * format, ...);
+/*Writes the level info and the rows of the board to 'out' ('.' and '@' mark dots and portals on
+empty cells), streaming the rows in DUMP_CHUNK pieces so any size fits in constant memory.
+Returns the bytes written, -1 on a write error or an empty board*/
+long dump_board(board_t* board, FILE* out, int mode);
 
-/*Writes the board and its contents to the open debug file*/
-void print_board(board_t* board);
+/*Writes the board and its contents to the open debug file (render/debug), in DUMP_PLAIN or
+DUMP_RLE*/
+void print_board(board_t* board, int mode);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "board.h"
+#include "snapshot.h"
+#include <stdio.h>
+
+#define CHECKPOINT_FLUSH_MS 100         // the writer flushes the journal at least this often
+#define CHECKPOINT_FLUSH_BYTES 65536    // or as soon as this much is pending
+
+/*Checkpoint file: a full base snapshot of the board followed by an append-only journal of the
+deltas made since. A background thread does all the writing; agent threads only append encoded
+records to a memory buffer. Agent structs are stored raw, so files are only readable by the
+same build*/
+typedef struct {
+    FILE* file;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int stop;
+
+    // Base snapshot waiting to be written (replaces the whole file)
+    board_snapshot_t base;
+    board_snapshot_t writing;
+    int base_pending;
+    uint32_t base_tick;
+    char level_path[2 * MAX_FILENAME];
+
+    // Encoded journal records not written yet; the writer swaps 'pending' with 'spare'
+    char* pending;
+    size_t pending_len, pending_cap;
+    char* spare;
+    size_t spare_cap;
+
+    uint64_t records;   // journal records written since the last base
+} checkpoint_t;
+
+/*Creates/truncates the checkpoint file and starts the writer thread. Returns -1 on failure*/
+int checkpoint_open(checkpoint_t* cp, const char* path);
+
+/*Takes a new base snapshot of the board loaded from 'level_path'; the file is rewritten
+with it and the journal starts over. Agent threads must be stopped*/
+int checkpoint_base(checkpoint_t* cp, board_t* board, const char* level_path);
+
+/*Delta hook (see add_delta_hook) that appends the delta to the journal*/
+void checkpoint_hook(void* ctx, const board_delta_t* delta);
+
+/*Writes everything still pending, stops the writer and closes the file*/
+void checkpoint_close(checkpoint_t* cp);
+
+/*Reads the path of the level a checkpoint file was taken on. Returns -1 if it is not a checkpoint*/
+int checkpoint_level(const char* path, char* level_path, size_t len);
+
+/*Loads the base snapshot of a checkpoint into a board already loaded from the same level and
+replays the journal on top of it. Returns the number of records replayed, or -1 on error*/
+long checkpoint_load(const char* path, board_t* board);
+
+#endif
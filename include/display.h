@@ -8,6 +8,8 @@
 #define DRAW_GAME_OVER 0
 #define DRAW_WIN 1
 #define DRAW_MENU 2
+#define DRAW_SPECTATE 3   // a spectator's view: the tick instead of the controls
+#define DRAW_METRICS 0x10 // flag OR'ed into the mode: adds the metrics overlay under the status line
 
 
 /*
@@ -38,6 +40,13 @@ void refresh_screen();
 /*Ncurses will be reading the player's inputs*/
 char get_input();
 
+/*Blocks until a key arrives, terminal_wakeup is called or 'timeout_ms' passes (-1 waits forever).
+Returns the key like get_input, or '\0' when woken up without one*/
+char wait_input(int timeout_ms);
+
+/*Wakes up wait_input from any thread (e.g. the board changed or the game ended)*/
+void terminal_wakeup();
+
 void terminal_cleanup();
 
 #endif
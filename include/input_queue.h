@@ -0,0 +1,49 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define MAX_INPUT_DEPTH 64      // slots in the ring, must be a power of two
+#define DEFAULT_INPUT_DEPTH 8   // commands buffered when no depth is configured
+
+typedef struct {
+    char command;
+    uint64_t pushed_ns; // monotonic time when the key was read
+} input_cmd_t;
+
+/*Bounded single-producer/single-consumer ring of timestamped commands.
+The producer (input path) only writes 'tail', the consumer (pacman thread) only writes 'head'*/
+typedef struct {
+    input_cmd_t slots[MAX_INPUT_DEPTH];
+    int depth;              // how many commands can be pending (<= MAX_INPUT_DEPTH)
+    atomic_uint head;       // next slot to pop
+    atomic_uint tail;       // next slot to push
+    atomic_uint dropped;    // commands rejected because the queue was full
+
+    // input-to-move latency, only touched by the consumer
+    unsigned lat_count;
+    uint64_t lat_total_ns;
+    uint64_t lat_min_ns;
+    uint64_t lat_max_ns;
+} input_queue_t;
+
+/*Monotonic clock in nanoseconds*/
+uint64_t now_ns();
+
+/*Empties the queue and sets how many commands it can hold (0 uses DEFAULT_INPUT_DEPTH)*/
+void input_queue_init(input_queue_t* q, int depth);
+
+/*Producer side: queues a command stamped with the current time, returns -1 if the queue is full*/
+int input_queue_push(input_queue_t* q, char command);
+
+/*Consumer side: takes the oldest command into 'out', returns 0 if the queue is empty*/
+int input_queue_pop(input_queue_t* q, input_cmd_t* out);
+
+/*Consumer side: records the latency between the command being read and being applied*/
+void input_queue_record_latency(input_queue_t* q, const input_cmd_t* cmd);
+
+/*Writes the latency statistics of the queue to the debug file*/
+void input_queue_report(input_queue_t* q, const char* name);
+
+#endif
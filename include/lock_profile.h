@@ -0,0 +1,55 @@
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include "board.h"
+#include <stdio.h>
+
+#define LOCK_REGION_MAX 64      // largest side of a region, in cells (DEFAULT_TILE_SIZE of tiles.h)
+#define LOCK_MAP_MAX 64         // regions per side of the heatmap below which regions shrink
+#define LOCK_HOT_CELLS 4096     // cells tracked one by one, picked by their first contention
+#define LOCK_HOT_PROBES 16      // slots looked at before a contended cell is left untracked
+
+/*Contention counters, updated with relaxed atomics by whichever thread locks the cell*/
+typedef struct {
+    atomic_uint_least64_t acquisitions;
+    atomic_uint_least64_t contended;    // acquisitions that found the mutex taken
+    atomic_uint_least64_t wait_ns;      // total time spent blocked on the mutex
+    atomic_uint_least64_t hold_ns;      // total time the mutex was held
+} lock_stats_t;
+
+/*A cell of the top-N list. Its counters start when the cell is first contended*/
+typedef struct {
+    atomic_int index;       // cell + 1, 0 while the slot is free
+    lock_stats_t stats;
+} lock_hot_cell_t;
+
+/*Lock statistics of a board, allocated by alloc_board when board->profile_locks is set. The
+counters are kept per square region, so memory and the heatmaps stay small on huge boards:
+regions are LOCK_REGION_MAX cells wide, or narrower on boards small enough that a map of at
+most LOCK_MAP_MAX regions per side still shows single cells. Only the cells that get contended
+are tracked one by one, in a fixed hash table, for the list of most contended cells*/
+struct lock_profile {
+    int width, height;
+    int region;                 // side of a region in cells, a power of two
+    int regions_x, regions_y;
+    lock_stats_t* regions;
+    lock_hot_cell_t* hot;       // LOCK_HOT_CELLS slots, open addressing
+    atomic_uint hot_dropped;    // contentions of cells that found no free slot
+};
+typedef struct lock_profile lock_profile_t;
+
+/*Allocates zeroed statistics for a width x height board. Returns NULL on failure*/
+lock_profile_t* lock_profile_create(int width, int height);
+
+/*Locks 'mutex' (cell 'index'), timing the wait when it is already taken*/
+void lock_profile_acquire(lock_profile_t* prof, pthread_mutex_t* mutex, int index);
+
+/*Unlocks 'mutex' (cell 'index') and adds the time it was held*/
+void lock_profile_release(lock_profile_t* prof, pthread_mutex_t* mutex, int index);
+
+/*Writes the wait and hold heatmaps over the regions and the most contended cells to 'out'*/
+void lock_profile_write(lock_profile_t* prof, board_t* board, FILE* out);
+
+void lock_profile_free(lock_profile_t* prof);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOG_RING_SIZE 65536     // bytes buffered per thread, must be a power of two
+#define LOG_MAX_THREADS 64      // rings in the pool (threads logging at the same time)
+#define LOG_LINE_MAX 8192       // longest message, longer ones are truncated
+#define LOG_FLUSH_MS 20         // how often the flusher thread drains the rings
+
+// Calls below this level are compiled out (set from the Makefile, see `make release`)
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN 0
+#endif
+
+typedef enum {
+    LOG_LEVEL_TRACE = 0,    // per-frame or per-key detail
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+} log_level_t;
+
+typedef enum {
+    LOG_CAT_LOADER = 0,     // level, pacman and ghost files
+    LOG_CAT_MOVEMENT,       // agent moves, deaths and input
+    LOG_CAT_RENDER,         // screen refreshes and board dumps
+    LOG_CAT_BACKUP,         // quicksaves, checkpoints and rewinds
+    LOG_N_CATEGORIES,
+} log_category_t;
+
+/*Runtime threshold of each category, set with log_configure before the agent threads start*/
+extern int log_levels[LOG_N_CATEGORIES];
+
+/*Logs at 'level' in 'cat' when the level passes both thresholds. The compile-time test is
+constant, so with the level below LOG_LEVEL_MIN the call and its arguments are removed
+(while still counting as used, so variables kept only for logging do not warn)*/
+#define log_at(level, cat, ...) \
+    do { \
+        if ((level) >= LOG_LEVEL_MIN && (level) >= log_levels[cat]) \
+            log_write((level), (cat), __VA_ARGS__); \
+    } while (0)
+
+#define log_trace(cat, ...) log_at(LOG_LEVEL_TRACE, cat, __VA_ARGS__)
+#define log_debug(cat, ...) log_at(LOG_LEVEL_DEBUG, cat, __VA_ARGS__)
+#define log_info(cat, ...) log_at(LOG_LEVEL_INFO, cat, __VA_ARGS__)
+#define log_warn(cat, ...) log_at(LOG_LEVEL_WARN, cat, __VA_ARGS__)
+#define log_error(cat, ...) log_at(LOG_LEVEL_ERROR, cat, __VA_ARGS__)
+
+/*Byte ring owned by one logging thread at a time. The owner only writes 'tail', the flusher
+only writes 'head'; both count bytes since the ring was created, the position is taken modulo
+LOG_RING_SIZE. Each record is a log_record_t followed by the message, padded to 8 bytes*/
+typedef struct {
+    unsigned char data[LOG_RING_SIZE];
+    atomic_size_t head;     // next byte the flusher reads
+    atomic_size_t tail;     // next byte the owner writes
+    atomic_int in_use;      // claimed by a live thread
+    atomic_uint dropped;    // messages lost because the ring was full
+    unsigned reported;      // drops already written to the file, only touched by the flusher
+} log_ring_t;
+
+typedef struct {
+    uint64_t ts_ns;         // now_ns() when the message was logged
+    uint32_t tid;           // sequential id of the logging thread, in order of first message
+    uint32_t len;           // bytes of text after the header
+} log_record_t;
+
+/*Opens the debug file and starts the flusher thread*/
+void open_debug_file(char *filename);
+
+/*Stops the flusher, writes whatever is still buffered and closes the debug file*/
+void close_debug_file();
+
+/*Formats the message into the calling thread's ring, prefixed with the time since the file was
+opened and the thread id. Never blocks and never makes a syscall; when the ring is full the
+message is dropped and counted*/
+void debug(const char * format, ...);
+
+/*Like debug, with the category and level written before the message. Use the log_* macros*/
+void log_write(log_level_t level, log_category_t cat, const char * format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/*Sets the runtime thresholds from a comma separated list of "level" (every category) or
+"category=level", e.g. "info,movement=trace". Returns -1 if the list has an unknown name*/
+int log_configure(const char* spec);
+
+/*Writes the message straight to the file and flushes it, like the logger before the rings did.
+For messages that must reach the disk before the process goes away*/
+void debug_sync(const char * format, ...);
+
+/*Locks the debug file for the calling thread and returns it (NULL when it is not open), after
+writing out what the rings hold and a line prefix. For output too large for one message: write
+it with stdio in pieces, then call debug_stream_end. The flusher waits meanwhile, so keep it short
+of a whole game*/
+FILE* debug_stream_begin();
+
+/*Flushes and unlocks the file returned by debug_stream_begin (nothing for NULL)*/
+void debug_stream_end(FILE* stream);
+
+#endif
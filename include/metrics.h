@@ -0,0 +1,107 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define METRICS_MAX_THREADS 64  // slots in the pool (threads updating metrics at the same time)
+#define METRICS_BUCKETS 32      // histogram bucket b counts samples in [2^b, 2^(b+1)) ns
+#define METRICS_INTERVAL_MS 1000 // how often the stats file gets a new line
+#define METRICS_SAMPLE_EVERY 16 // one in this many moves/locks is timed, must be a power of two
+
+typedef enum {
+    METRIC_PACMAN_MOVES = 0,
+    METRIC_GHOST_MOVES,
+    METRIC_INVALID_MOVES,   // moves of either kind that returned INVALID_MOVE
+    METRIC_DEATHS,
+    METRIC_TICKS,
+    METRIC_TICK_OVERRUNS,   // ticks whose work took longer than the level's tempo
+    METRIC_N_COUNTERS,
+} metric_counter_t;
+
+typedef enum {
+    METRIC_HIST_MOVE_NS = 0,    // time inside move_pacman/move_ghost
+    METRIC_HIST_LOCK_HOLD_NS,   // time between lock_positions and unlock_positions
+    METRIC_HIST_TICK_NS,        // work done by the pacman thread in one tick, without the sleep
+    METRIC_N_HISTOGRAMS,
+} metric_hist_t;
+
+/*Counters and histograms of one thread. Only the owning thread writes them (relaxed load and
+store, no locked instructions), the dumper reads them; slots are summed for the totals*/
+typedef struct {
+    atomic_uint_least64_t counters[METRIC_N_COUNTERS];
+    atomic_uint_least64_t buckets[METRIC_N_HISTOGRAMS][METRICS_BUCKETS];
+    atomic_int in_use;
+} __attribute__((aligned(64))) metrics_slot_t;
+
+/*Totals over every slot*/
+typedef struct {
+    uint64_t counters[METRIC_N_COUNTERS];
+    uint64_t buckets[METRIC_N_HISTOGRAMS][METRICS_BUCKETS];
+} metrics_totals_t;
+
+/*Whether the update functions record anything (off until metrics_start or metrics_enable)*/
+extern atomic_int metrics_enabled;
+
+extern _Thread_local metrics_slot_t* metrics_slot;
+extern _Thread_local unsigned metrics_sample_seq;
+
+/*Claims a slot for the calling thread (NULL if the pool is exhausted)*/
+metrics_slot_t* metrics_claim_slot();
+
+static inline metrics_slot_t* metrics_thread_slot() {
+    return metrics_slot ? metrics_slot : metrics_claim_slot();
+}
+
+static inline int metrics_on() {
+    return atomic_load_explicit(&metrics_enabled, memory_order_relaxed);
+}
+
+/*Whether the caller should time this event: metrics are on and it is the thread's
+METRICS_SAMPLE_EVERY-th call. Reading the clock costs more than the rest of a move, so the
+histograms hold a sample while the counters stay exact*/
+static inline int metrics_sample() {
+    return metrics_on() && (metrics_sample_seq++ & (METRICS_SAMPLE_EVERY - 1)) == 0;
+}
+
+/*Adds 'n' to a counter of the calling thread*/
+static inline void metric_count(metric_counter_t c, uint64_t n) {
+    if (!metrics_on()) return;
+    metrics_slot_t* slot = metrics_thread_slot();
+    if (!slot) return;
+    uint64_t v = atomic_load_explicit(&slot->counters[c], memory_order_relaxed);
+    atomic_store_explicit(&slot->counters[c], v + n, memory_order_relaxed);
+}
+
+/*Adds a sample of 'ns' nanoseconds to a histogram of the calling thread*/
+static inline void metric_record(metric_hist_t h, uint64_t ns) {
+    if (!metrics_on()) return;
+    metrics_slot_t* slot = metrics_thread_slot();
+    if (!slot) return;
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (b >= METRICS_BUCKETS) b = METRICS_BUCKETS - 1;
+    uint64_t v = atomic_load_explicit(&slot->buckets[h][b], memory_order_relaxed);
+    atomic_store_explicit(&slot->buckets[h][b], v + 1, memory_order_relaxed);
+}
+
+/*Turns recording on or off*/
+void metrics_enable(int on);
+
+/*Turns recording on and starts a thread that appends the totals to 'path' every
+METRICS_INTERVAL_MS, one JSON object per line. Returns -1 if the file cannot be created*/
+int metrics_start(const char* path);
+
+/*Writes a last line and stops the thread started by metrics_start*/
+void metrics_stop();
+
+/*Sums every slot into 'out'*/
+void metrics_collect(metrics_totals_t* out);
+
+/*Upper bound (ns) of the bucket holding the 'pct' percentile of a histogram, 0 when empty*/
+uint64_t metrics_percentile(const uint64_t* buckets, double pct);
+
+/*One line for the on-screen overlay, with rates measured since the previous call*/
+void metrics_summary(char* buf, size_t len);
+
+#endif
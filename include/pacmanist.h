@@ -0,0 +1,54 @@
+#ifndef PACMANIST_H
+#define PACMANIST_H
+
+#include "board.h"
+
+/*Embedding API of libpacmanist: one game on one level, advanced by the caller tick by tick
+with board_tick (no threads, no sleeps, no terminal). A game is not thread-safe; use one per
+thread or lock around the calls*/
+typedef struct pacmanist pacmanist_t;
+
+/*Snapshot of the values a harness usually checks after stepping*/
+typedef struct {
+    int width, height;
+    uint32_t tick;
+    game_state_t state;
+    int pacman_x, pacman_y; // pacman 0
+    int pacman_alive;
+    int points;
+    int n_pacmans;
+    int dots_left;
+    int n_ghosts;
+} pacmanist_info_t;
+
+/*Loads the level at 'level_path' (with its .p/.m files next to it) and starts the round.
+'points' is the score the pacman starts with. Returns NULL if the level cannot be loaded*/
+pacmanist_t* pacmanist_create(const char* level_path, int points);
+
+/*Runs up to 'ticks' ticks, stopping early when the round ends. Each tick takes the oldest
+queued input of every typed pacman, if any. Returns the ticks run*/
+long pacmanist_step(pacmanist_t* game, long ticks);
+
+/*Queues a key (W/A/S/D) for the pacman, used by the next ticks in order.
+Returns -1 if the queue is full*/
+int pacmanist_input(pacmanist_t* game, char key);
+
+/*pacmanist_input for pacman 'pacman' of a level with several (its .p script is KEYS).
+Returns -1 if the queue is full or there is no such pacman*/
+int pacmanist_input_pacman(pacmanist_t* game, int pacman, char key);
+
+/*Restarts a round that has ended (after a death, the pacman stays dead)*/
+void pacmanist_resume(pacmanist_t* game);
+
+void pacmanist_info(pacmanist_t* game, pacmanist_info_t* info);
+
+/*Character of the cell at (x, y) as drawn by the game: 'W', 'P', 'M', '@' (portal),
+'.' (dot) or ' '. Returns '\0' outside the board*/
+char pacmanist_cell(pacmanist_t* game, int x, int y);
+
+/*The underlying board, for everything the API above does not cover (delta hooks, snapshots)*/
+board_t* pacmanist_board(pacmanist_t* game);
+
+void pacmanist_destroy(pacmanist_t* game);
+
+#endif
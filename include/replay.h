@@ -0,0 +1,77 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "board.h"
+#include <stdio.h>
+#include <pthread.h>
+
+#define REPLAY_MAGIC "PACREC1"  // first 8 bytes of a recording (with the '\0')
+
+/*Kinds of record in a recording. Each record is a rec_event_t followed by 'len' bytes*/
+typedef enum {
+    REC_LEVEL = 1,  // a level was loaded, payload: its path
+    REC_KEY,        // a pacman used a typed command at 'tick', arg: the key, payload: the pacman
+                    // index as one byte (no payload for pacman 0)
+    REC_END,        // a round ended at 'tick', arg: game_state_t, payload: board_digest
+    REC_SAVE,       // a quicksave was taken
+    REC_RESTORE,    // the newest quicksave was restored
+    REC_REWIND,     // the board was rewound REWIND_TICKS
+} rec_kind_t;
+
+typedef struct {
+    uint32_t tick;
+    uint8_t kind;   // rec_kind_t
+    uint8_t arg;
+    uint16_t len;   // payload bytes after the record
+} rec_event_t;
+
+/*Writer of a recording. Keys come from the engine thread (recorder_tick) and everything else
+from the main loop while it is stopped; 'lock' keeps their records apart*/
+typedef struct {
+    FILE* f;
+    long events;
+    pthread_mutex_t lock;
+} recorder_t;
+
+/*Creates the recording with its header: the seed of the session (board->seed, see board_seed_agents) and the rewind buffer
+size (-1 without rewinding). Returns -1 if the file cannot be created*/
+int recorder_open(recorder_t* rec, const char* path, uint64_t seed, long rewind_kb);
+
+void recorder_level(recorder_t* rec, const char* level_path);
+
+void recorder_key(recorder_t* rec, uint32_t tick, int pacman, char key);
+
+/*One tick of a recorded game, the same one replay_run plays back: pops at most one command from
+the input queue of each living typed pacman, records it at the current tick and runs
+board_tick_keys. 'inputs' gets the popped commands (for their latency); returns a bitmask of
+the pacmans that got one*/
+unsigned recorder_tick(recorder_t* rec, board_t* board, input_cmd_t* inputs);
+
+/*Ends a round, storing the digest of the board so a replay can check it reached the same state*/
+void recorder_end(recorder_t* rec, board_t* board, game_state_t state);
+
+/*REC_SAVE, REC_RESTORE or REC_REWIND at the current tick*/
+void recorder_action(recorder_t* rec, board_t* board, rec_kind_t kind);
+
+void recorder_close(recorder_t* rec);
+
+/*FNV-1a hash of the cells, the dots and the state of every agent*/
+uint64_t board_digest(board_t* board);
+
+typedef struct {
+    long ticks;             // ticks simulated
+    long keys;              // recorded commands fed to the pacman
+    int levels;
+    int rounds;             // REC_END records checked
+    int mismatches;         // rounds whose board differed from the recorded digest
+    uint32_t first_mismatch_tick;
+    uint64_t digest;        // board_digest when the replay finished
+} replay_result_t;
+
+/*Plays a recording back on one thread with no display and no sleeps: every tick moves the
+pacmans (with the recorded commands of that tick, if any) and then every ghost in order. The
+same recording always gives the same boards. Returns -1 if the file is not a recording
+or is malformed, such as two keys of the same pacman in one tick*/
+int replay_run(const char* path, replay_result_t* result);
+
+#endif
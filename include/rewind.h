@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "board.h"
+
+#define DEFAULT_REWIND_KB 1024  // memory kept for rewinding when none is configured
+#define REWIND_TICKS 50         // ticks rewound by the U key or a pacman death
+
+/*Fixed-size byte ring with the most recent deltas in the form needed to undo them. Records
+are variable length (a cell change takes 11 bytes, an agent step 38), so the memory a tick
+uses is proportional to what changed in it, not to the board size. When the ring is full the
+oldest records are dropped*/
+typedef struct {
+    unsigned char* ring;
+    size_t capacity;    // bytes in the ring
+    size_t start;       // offset of the oldest record
+    size_t used;        // bytes in use
+    uint32_t horizon;   // earliest tick that can still be rewound to (older records were dropped)
+    pthread_mutex_t mutex;
+} rewind_buffer_t;
+
+/*Allocates a ring of 'kilobytes' (0 uses DEFAULT_REWIND_KB). Returns -1 on failure*/
+int rewind_init(rewind_buffer_t* rb, size_t kilobytes);
+
+/*Delta hook (see add_delta_hook) that records the delta*/
+void rewind_hook(void* ctx, const board_delta_t* delta);
+
+/*Undoes every recorded delta from the last 'ticks' ticks, newest first, and moves board->tick
+back. Agent threads must be stopped. Returns how many ticks were actually rewound, which is
+less than asked when the history does not go back that far*/
+unsigned rewind_ticks(rewind_buffer_t* rb, board_t* board, unsigned ticks);
+
+/*Forgets the history, so the board cannot be rewound past its current tick
+(call after loading a level or replacing the board with a snapshot)*/
+void rewind_clear(rewind_buffer_t* rb, board_t* board);
+
+/*Releases the ring*/
+void rewind_free(rewind_buffer_t* rb);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ROW_DECODER_H
+#define ROW_DECODER_H
+
+#include <stdint.h>
+
+/*Decodes 'len' characters of a level row into the board planes, starting at cell 'first'.
+'X' becomes a wall ('W' in cells), 'o' a dot and '@' a portal; anything else is empty space.
+Uses SSE2/AVX2 when the CPU has them, 16/32 characters per step*/
+void decode_row(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len);
+
+/*Character-by-character decoder, used for the row tail and as the benchmark baseline*/
+void decode_row_scalar(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len);
+
+#endif
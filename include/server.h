@@ -0,0 +1,63 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "pacmanist.h"
+#include "metrics.h"
+
+#define SERVER_DEFAULT_BUDGET 64    // ticks a session runs each time a worker picks it up
+
+/*Chooses the key the pacman of 'game' gets this tick ('\0' for none); called on a worker thread
+by the only thread running that session at the time*/
+typedef char (*session_policy_t)(pacmanist_t* game, void* ctx);
+
+/*One game hosted by the server*/
+typedef struct {
+    pacmanist_t* game;
+    session_policy_t policy;
+    void* ctx;
+    long ticks_target;      // ticks to run (the session also stops when its round ends)
+    long ticks;             // ticks run so far
+    uint64_t started_ns, finished_ns;
+    uint64_t service_ns;    // time spent stepping it
+    uint64_t ready_ns;      // when it last went back on the run queue
+    uint64_t max_wait_ns;   // longest time it waited on the run queue for a worker
+    uint64_t last_tick_ns;  // when its previous tick finished (server_run for the first)
+    uint64_t max_tick_ns;
+    uint64_t tick_buckets[METRICS_BUCKETS]; // wall time between its ticks, log2 buckets as in metrics.h
+} session_t;
+
+/*Fixed pool of workers sharing one FIFO run queue of sessions. A worker takes the session at
+the head, runs at most 'budget' ticks of it and puts it back at the tail, so every session
+advances at the same rate whatever the number of sessions or workers*/
+typedef struct server server_t;
+
+/*Totals of a run. The tick latencies are over every tick of every session: the wall time from
+one tick of a session to its next, so the first tick of a quantum includes the wait for a worker.
+p50/p99 are bucket upper bounds, like metrics_percentile*/
+typedef struct {
+    int sessions;
+    int workers;
+    long ticks;
+    double seconds;             // from server_run to the last session finishing
+    double ticks_per_second;
+    uint64_t tick_ns_p50, tick_ns_p99, tick_ns_max;  // wall time per tick seen by a session
+    uint64_t wait_ns_p50, wait_ns_p99, wait_ns_max;  // longest run queue wait of a session
+} server_stats_t;
+
+server_t* server_create(int workers, int budget);
+
+/*Adds a session running 'game' for 'ticks' ticks; the server does not own the game.
+Sessions are added before server_run. Returns -1 when out of memory*/
+int server_add(server_t* server, pacmanist_t* game, long ticks, session_policy_t policy, void* ctx);
+
+/*Runs every session to the end on the worker pool, then returns*/
+void server_run(server_t* server);
+
+/*Session 'i' in the order they were added*/
+session_t* server_session(server_t* server, int i);
+
+void server_stats(server_t* server, server_stats_t* stats);
+
+void server_destroy(server_t* server);
+
+#endif
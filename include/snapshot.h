@@ -0,0 +1,34 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "board.h"
+
+#define MAX_SNAPSHOTS 4 // quicksave slots kept per level
+
+/*Copy of everything in a board_t that changes while playing: the cell plane, the dot
+bitset and counters, and the agents with their script cursors. Portals, locks and the
+level metadata never change after loading and are not copied*/
+typedef struct {
+    int valid;
+    int width, height;
+    char* cells;
+    uint64_t* dots;
+    int dots_left;
+    int n_pacmans, n_ghosts;
+    pacman_t* pacmans;
+    ghost_t* ghosts;
+} board_snapshot_t;
+
+/*Saves the board into 'snap'. Buffers are reused when the dimensions match, so after the
+first save this is a handful of memcpy calls. Agent threads must be stopped. Returns -1 on
+allocation failure*/
+int snapshot_save(board_snapshot_t* snap, board_t* board);
+
+/*Writes a snapshot back into the board it was taken from (pending keypresses are dropped).
+Agent threads must be stopped. Returns -1 if the snapshot does not fit the board*/
+int snapshot_restore(board_snapshot_t* snap, board_t* board);
+
+/*Releases the snapshot buffers*/
+void snapshot_free(board_snapshot_t* snap);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include "board.h"
+#include <stddef.h>
+#include <pthread.h>
+
+#define SPECTATE_MAGIC 0x50414353u  // "SCAP"
+#define SPECTATE_VERSION 1
+#define SPECTATE_SLOTS 4            // frames in the ring
+#define SPECTATE_DEFAULT_NAME "/pacmanist"
+
+/*One pacman as seen by a spectator*/
+typedef struct {
+    int32_t x, y;
+    int32_t alive;
+    int32_t points;
+} spectate_pacman_t;
+
+/*One published frame. 'seq' is 2 * frame + 1 while the publisher writes the slot and
+2 * frame + 2 once it is complete, so a reader that sees the same even value before and after
+its copy has a whole frame. The cells (width * height bytes, as in board_t), then the dots and
+portal bitsets (one bit per cell, in 64-bit words) follow the struct*/
+typedef struct {
+    _Atomic uint64_t seq;
+    uint32_t tick;
+    int32_t state;          // game_state_t
+    int32_t width, height;
+    int32_t total_dots, dots_left;
+    int32_t n_pacmans;
+    spectate_pacman_t pacmans[MAX_PACMANS];
+    char level_name[MAX_FILENAME];
+} spectate_frame_t;
+
+/*Start of the shared memory object; the SPECTATE_SLOTS slots of 'slot_size' bytes follow it.
+The segment only grows: when a level needs bigger slots the publisher makes 'layout' odd,
+grows the object, moves the slots and makes 'layout' even again. Readers remap when 'map_size'
+is larger than what they mapped*/
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint64_t layout;    // odd while the slots are being resized
+    _Atomic uint64_t latest;    // newest complete frame, 0 before the first
+    _Atomic uint64_t map_size;  // bytes of the object
+    _Atomic uint64_t slot_size;
+    _Atomic int closed;         // set by spectate_close: no more frames will come
+} spectate_header_t;
+
+/*Publishing side. 'lock' keeps a second publisher out (the first alive pacman can change while
+one is publishing); readers never take it*/
+typedef struct {
+    char name[64];
+    int fd;
+    pthread_mutex_t lock;
+    spectate_header_t* header;
+    size_t mapped;
+    uint64_t frame;             // last frame published
+} spectate_feed_t;
+
+/*Reading side, one per viewer*/
+typedef struct {
+    int fd;
+    spectate_header_t* header;
+    size_t mapped;
+    spectate_frame_t* copy;     // the last frame read, with its planes
+    size_t copy_size;
+    uint64_t frame;             // number of 'copy', 0 before the first
+    long retries;               // copies thrown away because the publisher overwrote the slot meanwhile
+    pacman_t pacmans[MAX_PACMANS]; // storage for spectate_board_view
+} spectate_view_t;
+
+/*Creates (or takes over) the POSIX shared memory object 'name' ("/name"). Returns 0, or -1 with
+errno set*/
+int spectate_open(spectate_feed_t* feed, const char* name);
+
+/*Copies the board into the next slot of the ring and makes it the latest frame. Never waits
+for readers: a reader copying that slot just retries. Returns the frame number, -1 when the
+object cannot grow to the size of the board*/
+long spectate_publish(spectate_feed_t* feed, board_t* board);
+
+/*Marks the feed closed, unmaps it and removes the name (mapped viewers keep their mapping)*/
+void spectate_close(spectate_feed_t* feed);
+
+/*Maps the feed 'name' read-only. Returns 0, or -1 with errno set (EPROTO if it is not a feed)*/
+int spectate_attach(spectate_view_t* view, const char* name);
+
+/*Copies the newest frame into view->copy. Returns 1 for a new frame, 0 when there is nothing
+newer than the last one, -1 once the feed is closed and every frame has been read*/
+int spectate_read(spectate_view_t* view);
+
+void spectate_detach(spectate_view_t* view);
+
+static inline char* spectate_cells(spectate_frame_t* frame) {
+    return (char*)(frame + 1);
+}
+
+static inline uint64_t* spectate_dots(spectate_frame_t* frame) {
+    size_t cells = (size_t)frame->width * frame->height;
+    return (uint64_t*)(spectate_cells(frame) + (cells + 7) / 8 * 8);
+}
+
+static inline uint64_t* spectate_portals(spectate_frame_t* frame) {
+    return spectate_dots(frame) + ((size_t)frame->width * frame->height + 63) / 64;
+}
+
+/*Fills 'board' as a read-only view of the last frame read (planes pointing into view->copy, no
+locks and no ghost array), enough for draw_board*/
+void spectate_board_view(spectate_view_t* view, board_t* board);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SWARM_H
+#define SWARM_H
+
+#include "board.h"
+
+/*The ghosts of a board kept as a structure of arrays (positions, timers, the current command,
+one random state each) so a tick steps them in bulk instead of one move_ghost call per ghost.
+A tick has three passes:
+ 1. a branch-free loop over the arrays (vectorized at -O2) that runs the 'passo' timers, draws
+    the 'R' directions and computes the cell each ghost tries to enter;
+ 2. a claim count per target cell;
+ 3. in index order, a ghost moves at once when it is the only claimant of an empty cell and
+    stays put against a wall. Everything else - shared targets, ghosts, the pacman, 'C'/'T'
+    commands and charged ghosts - is a conflict, resolved one by one afterwards with the rules
+    of move_ghost.
+The 'R' directions come from each ghost's own generator (ghost_t.rng), drawn the same way
+move_ghost draws them, so a ghost walks the same random directions as under board_tick. The board must not be moved any other way while
+the swarm exists; board->ghosts is stale until swarm_store. The bulk passes do not emit deltas
+or move metrics, and a board with delta hooks is refused*/
+typedef struct swarm swarm_t;
+
+/*Copies the ghosts of 'board' into the arrays, with their 'R' generators.
+Returns NULL when out of memory or when the board has delta hooks*/
+swarm_t* swarm_create(board_t* board);
+
+/*One tick in the order of board_tick: the pacmans move ('key' goes to pacman 0), the tick
+advances, then every ghost moves once. Returns the number of ghosts that changed cell*/
+int swarm_tick(swarm_t* swarm, char key);
+
+/*Writes positions, timers, script progress and generators back to board->ghosts*/
+void swarm_store(swarm_t* swarm);
+
+/*swarm_store, then frees the arrays*/
+void swarm_destroy(swarm_t* swarm);
+
+#endif
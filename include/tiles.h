@@ -0,0 +1,57 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "board.h"
+#include <pthread.h>
+
+#define DEFAULT_TILE_SIZE 64    // cells per side of a tile
+
+/*Ghosts owned by one tile. 'members' is only touched by the worker stepping the tile; other
+workers hand ghosts over by pushing them on 'inbox', a lock-free stack linked through
+tile_sim_t.next, which the owner merges into 'members' at the end of the tick*/
+typedef struct {
+    int* members;
+    int n_members, cap_members;
+    atomic_int inbox;       // first ghost handed over, -1 when empty
+} tile_t;
+
+/*Tick-synchronous parallel stepping of a board split into square tiles. Tiles are coloured in
+a 2x2 pattern and stepped one colour at a time, so two tiles stepped at once are never
+neighbours: a ghost only moves one cell, which lands at most in an idle neighbour, and the
+cells need no mutexes (board->tile_owned). A ghost that changes tile is handed off through
+the destination's inbox. Charged ghosts slide across many tiles, so they are deferred and
+moved by one thread after the four colours*/
+typedef struct tile_sim {
+    board_t* board;
+    int tile_size;
+    int tiles_x, tiles_y;
+    tile_t* tiles;
+    int* next;              // handoff links, one per ghost (a ghost is in at most one stack)
+    atomic_int deferred;    // stack of charged ghosts for the serial phase
+
+    int n_workers;          // including the thread calling tiles_tick
+    int** worker_tiles;     // [worker * 4 + colour]: tiles of that colour the worker steps
+    int* worker_counts;     // sizes of worker_tiles
+    int** worker_owned;     // [worker]: every tile the worker merges
+    int* worker_owned_counts;
+    pthread_t* tids;
+    pthread_barrier_t barrier;
+    atomic_int stop;
+} tile_sim_t;
+
+/*Splits 'board' into tiles of 'tile_size' cells (>= 2, 0 for DEFAULT_TILE_SIZE), assigns its
+ghosts to them and starts 'workers' - 1 threads. The board must not be stepped any other way
+until tiles_destroy, and its delta hooks get called from several workers at once. Returns NULL on failure*/
+tile_sim_t* tiles_create(board_t* board, int tile_size, int workers);
+
+/*One tick in the order of board_tick: the pacmans move ('key' goes to pacman 0), the tick
+advances, then every ghost moves once*/
+void tiles_tick(tile_sim_t* sim, char key);
+
+/*Runs up to 'ticks' ticks without input, stopping when the round ends. Returns the ticks run*/
+long tiles_run(tile_sim_t* sim, long ticks);
+
+/*Stops the workers and gives the board back (cell mutexes on again)*/
+void tiles_destroy(tile_sim_t* sim);
+
+#endif
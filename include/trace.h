@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "input_queue.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_CHUNK_EVENTS 16384        // events per allocation of a thread's buffer
+#define TRACE_MAX_EVENTS (1 << 22)      // events kept per thread, later ones are counted and dropped
+
+/*One complete ("X") event: a span that started at 'start' and lasted 'dur', in trace_clock
+ticks. 'name' must be a string literal (only the pointer is stored)*/
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t dur;
+    int32_t arg;            // shown as args.id in the viewer, -1 for none
+} trace_event_t;
+
+/*Whether spans are being recorded (off until trace_start)*/
+extern atomic_int trace_enabled;
+
+static inline int trace_on() {
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+}
+
+/*Timestamp for spans: the TSC on x86, where it is a few times cheaper than clock_gettime,
+now_ns() elsewhere. trace_write converts ticks to time with a rate measured over the run*/
+static inline uint64_t trace_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+/*Start time for a span, or 0 when tracing is off (then trace_end does nothing)*/
+static inline uint64_t trace_begin() {
+    return trace_on() ? trace_clock() : 0;
+}
+
+/*Starts recording; trace_write saves everything recorded to 'path' at exit*/
+void trace_start(const char* path);
+
+/*Records the span 'name' from 'start' (a trace_begin value) until now into the calling
+thread's buffer. 'arg' is an agent index or -1*/
+void trace_end(const char* name, uint64_t start, int arg);
+
+/*Names the calling thread in the timeline (e.g. "ghost 2"); copied*/
+void trace_thread_name(const char* name);
+
+/*Writes every thread's buffer as Chrome trace-event JSON (open with Perfetto or
+chrome://tracing) and frees them. All traced threads must have finished; threads that trace
+again after a later trace_start get new buffers.
+Returns -1 if the file cannot be written or tracing was never started*/
+int trace_write();
+
+#endif
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE     // cpu_set_t, pthread_setaffinity_np and sched_getcpu
+#include "affinity.h"
+#include "log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int cpu;
+    int package, core;      // from sysfs, or 0 and the CPU number when unreadable
+    int sibling;            // rank among the hyperthreads of its core
+    int core_rank;          // rank of its core within the package
+} cpu_info_t;
+
+static affinity_policy_t policy = AFFINITY_NONE;
+static int order[AFFINITY_MAX_CPUS];    // CPU of slot i % n_order
+static int n_order;
+static cpu_set_t allowed;               // the process mask when the policy was set
+
+static int read_topology(int cpu, const char* name, int fallback) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE* f = fopen(path, "r");
+    if (!f) return fallback;
+    int value;
+    if (fscanf(f, "%d", &value) != 1) value = fallback;
+    fclose(f);
+    return value;
+}
+
+static int compare_compact(const void* a, const void* b) {
+    const cpu_info_t* x = a;
+    const cpu_info_t* y = b;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int compare_spread(const void* a, const void* b) {
+    const cpu_info_t* x = a;
+    const cpu_info_t* y = b;
+    if (x->sibling != y->sibling) return x->sibling - y->sibling;
+    if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+    if (x->package != y->package) return x->package - y->package;
+    return x->cpu - y->cpu;
+}
+
+// Orders the CPUs of 'mask' for a compact or spread placement, returns how many there are
+static int topology_order(const cpu_set_t* mask, affinity_policy_t p, int* out) {
+    static cpu_info_t cpus[AFFINITY_MAX_CPUS];
+    int n = 0;
+    for (int cpu = 0; cpu < AFFINITY_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, mask)) continue;
+        cpus[n++] = (cpu_info_t){ .cpu = cpu, .package = read_topology(cpu, "physical_package_id", 0),
+                                  .core = read_topology(cpu, "core_id", cpu) };
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (cpus[j].package != cpus[i].package) continue;
+            if (cpus[j].core == cpus[i].core && cpus[j].cpu < cpus[i].cpu) cpus[i].sibling++;
+        }
+    }
+    // Cores are counted by their first sibling, so the rank is dense within each package
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (cpus[j].package == cpus[i].package && cpus[j].sibling == 0 && cpus[j].core < cpus[i].core)
+                cpus[i].core_rank++;
+        }
+    }
+    qsort(cpus, n, sizeof(cpu_info_t), p == AFFINITY_SPREAD ? compare_spread : compare_compact);
+    for (int i = 0; i < n; i++) out[i] = cpus[i].cpu;
+    return n;
+}
+
+// Parses "0,2,4-7" into 'out', every CPU in 'mask'; returns the count or -1
+static int parse_list(const char* spec, const cpu_set_t* mask, int* out) {
+    int n = 0;
+    const char* s = spec;
+    while (*s) {
+        char* end;
+        long first = strtol(s, &end, 10);
+        if (end == s) return -1;
+        long last = first;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s) return -1;
+        }
+        if (first < 0 || last < first || last >= AFFINITY_MAX_CPUS) return -1;
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, mask) || n == AFFINITY_MAX_CPUS) return -1;
+            out[n++] = (int)cpu;
+        }
+        s = end;
+        if (*s == ',') s++;
+        else if (*s) return -1;
+    }
+    return n;
+}
+
+int affinity_configure(const char* spec) {
+    affinity_policy_t p;
+    if (strcmp(spec, "none") == 0) p = AFFINITY_NONE;
+    else if (strcmp(spec, "compact") == 0) p = AFFINITY_COMPACT;
+    else if (strcmp(spec, "spread") == 0) p = AFFINITY_SPREAD;
+    else p = AFFINITY_LIST;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (p != AFFINITY_NONE && sched_getaffinity(0, sizeof(mask), &mask) < 0) return -1;
+
+    static int cpus[AFFINITY_MAX_CPUS];
+    int n = 0;
+    if (p == AFFINITY_LIST) n = parse_list(spec, &mask, cpus);
+    else if (p != AFFINITY_NONE) n = topology_order(&mask, p, cpus);
+    if (n < 0 || (p != AFFINITY_NONE && n == 0)) return -1;
+
+    memcpy(order, cpus, n * sizeof(int));
+    n_order = n;
+    allowed = mask;
+    policy = p;
+    return 0;
+}
+
+affinity_policy_t affinity_policy(void) {
+    return policy;
+}
+
+const char* affinity_policy_name(affinity_policy_t p) {
+    switch (p) {
+        case AFFINITY_COMPACT: return "compact";
+        case AFFINITY_SPREAD: return "spread";
+        case AFFINITY_LIST: return "list";
+        default: return "none";
+    }
+}
+
+int affinity_cpu(int slot) {
+    if (policy == AFFINITY_NONE || n_order == 0 || slot < 0) return -1;
+    return order[slot % n_order];
+}
+
+int affinity_pin(int slot) {
+    int cpu = affinity_cpu(slot);
+    if (cpu < 0) return -1;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    if (err != 0) {
+        log_warn(LOG_CAT_LOADER, "Could not pin slot %d to CPU %d: %s\n", slot, cpu, strerror(err));
+        return -1;
+    }
+    return cpu;
+}
+
+int affinity_pin_role(board_t* board, affinity_role_t role, int index) {
+    return affinity_pin(affinity_slot(role, index, board->n_pacmans));
+}
+
+void affinity_unpin(void) {
+    if (policy == AFFINITY_NONE) return;
+    pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+}
+
+int affinity_current_cpu(void) {
+    return sched_getcpu();
+}
+
+void affinity_describe(char* buf, size_t size) {
+    size_t used = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < n_order && used < size; i++) {
+        int n = snprintf(buf + used, size - used, i ? " %d" : "%d", order[i]);
+        if (n < 0 || (size_t)n >= size - used) {
+            // Mark the cut with "..." when there is room for it
+            if (size >= 4) strcpy(buf + size - 4, "...");
+            return;
+        }
+        used += n;
+    }
+}
@@ -0,0 +1,1389 @@
+#include "board.h"
+#include "display.h"
+#include "row_decoder.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "metrics.h"
+#include "lock_profile.h"
+#include "trace.h"
+#include "replay.h"
+#include "pacmanist.h"
+#include "server.h"
+#include "tiles.h"
+#include "swarm.h"
+#include "affinity.h"
+#include "spectate.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Monotonic clock in seconds
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills 'rows' with a random size x size maze: walls on the border, ~25% walls inside,
+// dots everywhere else and a single portal near the bottom right corner
+static void generate_rows(char* rows, int size, unsigned int seed) {
+    for (int y = 0; y < size; y++) {
+        char* row = rows + (size_t)y * size;
+        for (int x = 0; x < size; x++) {
+            if (y == 0 || x == 0 || y == size - 1 || x == size - 1 || rand_r(&seed) % 4 == 0)
+                row[x] = 'X';
+            else
+                row[x] = 'o';
+        }
+    }
+    rows[(size_t)(size - 2) * size + size - 2] = '@';
+}
+
+// Writes a level file with the generated rows
+static int write_level(const char* path, const char* rows, int size) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror("Failed to create level file");
+        return -1;
+    }
+    fprintf(f, "DIM %d %d\nTEMPO 10\n", size, size);
+    for (int y = 0; y < size; y++) {
+        fwrite(rows + (size_t)y * size, 1, size, f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return 0;
+}
+
+// Writes the rows to a new temporary level file; 'path' is a mkstemp template
+static int create_level_file(char* path, const char* rows, int size) {
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("Failed to create temporary file");
+        return -1;
+    }
+    close(fd);
+    return write_level(path, rows, size);
+}
+
+// Loads a generated size x size level into 'board'
+static int load_generated_level(board_t* board, int size) {
+    char* rows = malloc((size_t)size * size);
+    if (!rows) {
+        fprintf(stderr, "Out of memory for a %dx%d level\n", size, size);
+        return -1;
+    }
+    generate_rows(rows, size, 42);
+
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    int result = create_level_file(path, rows, size);
+    free(rows);
+    if (result < 0) return -1;
+
+    memset(board, 0, sizeof(board_t));
+    load_level_file(board, path, 0, 0);
+    unlink(path);
+    return 0;
+}
+
+// Times decode_row (SIMD) against decode_row_scalar and the full load_level_file on a size x size level
+static int bench_load(int size) {
+    size_t cells = (size_t)size * size;
+    char* rows = malloc(cells);
+    char* out = malloc(cells);
+    uint64_t* dots = calloc((cells + 63) / 64, sizeof(uint64_t));
+    uint64_t* portals = calloc((cells + 63) / 64, sizeof(uint64_t));
+    if (!rows || !out || !dots || !portals) {
+        fprintf(stderr, "Out of memory for a %dx%d level\n", size, size);
+        return -1;
+    }
+    generate_rows(rows, size, 42);
+
+    double t0 = now_s();
+    for (int y = 0; y < size; y++)
+        decode_row_scalar(out, dots, portals, y * size, rows + (size_t)y * size, size);
+    double scalar = now_s() - t0;
+
+    memset(dots, 0, (cells + 63) / 64 * sizeof(uint64_t));
+    memset(portals, 0, (cells + 63) / 64 * sizeof(uint64_t));
+    t0 = now_s();
+    for (int y = 0; y < size; y++)
+        decode_row(out, dots, portals, y * size, rows + (size_t)y * size, size);
+    double simd = now_s() - t0;
+
+    printf("decode %dx%d: scalar %.1f ms (%.0f MB/s), simd %.1f ms (%.0f MB/s)\n", size, size,
+           scalar * 1e3, cells / scalar / 1e6, simd * 1e3, cells / simd / 1e6);
+
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    if (create_level_file(path, rows, size) < 0) return -1;
+    free(rows);
+    free(out);
+    free(dots);
+    free(portals);
+
+    board_t board;
+    memset(&board, 0, sizeof(board_t));
+    t0 = now_s();
+    load_level_file(&board, path, 0, 0);
+    double load = now_s() - t0;
+    printf("load_level_file %dx%d: %.1f ms (%d dots)\n", size, size, load * 1e3, board.total_dots);
+
+    unload_level(&board);
+    unlink(path);
+    return 0;
+}
+
+// Times snapshot_save and snapshot_restore on a size x size level
+static int bench_snapshot(int size) {
+    board_t board;
+    if (load_generated_level(&board, size) < 0) return -1;
+
+    board_snapshot_t snap;
+    memset(&snap, 0, sizeof(board_snapshot_t));
+
+    // The first save allocates the buffers, the rest reuse them
+    double t0 = now_s();
+    if (snapshot_save(&snap, &board) < 0) {
+        fprintf(stderr, "Out of memory for the snapshot\n");
+        unload_level(&board);
+        return -1;
+    }
+    double first = now_s() - t0;
+
+    const int iterations = 20;
+    t0 = now_s();
+    for (int i = 0; i < iterations; i++) snapshot_save(&snap, &board);
+    double save = (now_s() - t0) / iterations;
+
+    t0 = now_s();
+    for (int i = 0; i < iterations; i++) snapshot_restore(&snap, &board);
+    double restore = (now_s() - t0) / iterations;
+
+    printf("snapshot %dx%d: first save %.1f us, save %.1f us, restore %.1f us\n", size, size,
+           first * 1e6, save * 1e6, restore * 1e6);
+
+    snapshot_free(&snap);
+    unload_level(&board);
+    return 0;
+}
+
+// Places 'n' ghosts with a random-walk script on the empty cells of 'board', trying every
+// 'stride'-th cell from cell 'first'
+static int spawn_ghosts_from(board_t* board, int n, int first, int stride) {
+    board->ghosts = calloc(n, sizeof(ghost_t));
+    if (!board->ghosts) return -1;
+    int placed = 0;
+    int cells = board->width * board->height;
+    for (int i = first; i < cells && placed < n; i += stride) {
+        if (board->cells[i] != ' ') continue;
+        ghost_t* ghost = &board->ghosts[placed++];
+        ghost->pos_x = i % board->width;
+        ghost->pos_y = i / board->width;
+        ghost->moves[0] = (command_t){ .command = 'R', .turns = 1, .turns_left = 1 };
+        ghost->n_moves = 1;
+        board->cells[i] = 'M';
+    }
+    board->n_ghosts = placed;
+    board_seed_agents(board, board->seed);
+    return 0;
+}
+
+static int spawn_random_ghosts(board_t* board, int n) {
+    return spawn_ghosts_from(board, n, 0, 7);
+}
+
+// Times rewind_ticks against how far back it goes, with 'n_ghosts' ghosts walking a size x size level
+static int bench_rewind(int size, int n_ghosts) {
+    board_t board;
+    if (load_generated_level(&board, size) < 0) return -1;
+    if (spawn_random_ghosts(&board, n_ghosts) < 0) {
+        fprintf(stderr, "Out of memory for the ghosts\n");
+        unload_level(&board);
+        return -1;
+    }
+
+    rewind_buffer_t rb;
+    if (rewind_init(&rb, 64 * 1024) < 0) {
+        fprintf(stderr, "Out of memory for the rewind buffer\n");
+        unload_level(&board);
+        return -1;
+    }
+    add_delta_hook(&board, rewind_hook, &rb);
+    rewind_clear(&rb, &board);
+
+    // Each depth plays that many ticks and then rewinds all of them, back to the same board
+    const unsigned depths[] = { 1, 10, 100, 1000 };
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        double t0 = now_s();
+        for (unsigned t = 0; t < depths[d]; t++) {
+            for (int i = 0; i < board.n_ghosts; i++) {
+                ghost_t* ghost = &board.ghosts[i];
+                move_ghost(&board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+            }
+            atomic_fetch_add(&board.tick, 1);
+        }
+        double simulate = now_s() - t0;
+        size_t used = rb.used;
+
+        t0 = now_s();
+        unsigned rewound = rewind_ticks(&rb, &board, depths[d]);
+        double rewind = now_s() - t0;
+
+        printf("rewind %u ticks (%d ghosts, %zu KB of history): %.1f us, simulate %.1f us\n",
+               rewound, board.n_ghosts, used / 1024, rewind * 1e6, simulate * 1e6);
+    }
+
+    remove_delta_hook(&board, rewind_hook, &rb);
+    rewind_free(&rb);
+    unload_level(&board);
+    return 0;
+}
+
+// Steps 'n_ghosts' random-walk ghosts for 'ticks' ticks on one thread, returns moves per second
+static double run_ghost_ticks(board_t* board, int ticks) {
+    double t0 = now_s();
+    for (int t = 0; t < ticks; t++) {
+        for (int i = 0; i < board->n_ghosts; i++) {
+            ghost_t* ghost = &board->ghosts[i];
+            move_ghost(board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+        }
+    }
+    return (double)ticks * board->n_ghosts / (now_s() - t0);
+}
+
+// Headless move throughput with the movement trace enabled and disabled at runtime, with metrics
+// recording and with the timeline (trace.h) on; build with `make release` to compare with the
+// log calls compiled out
+static int bench_moves(int size) {
+    board_t board;
+    if (load_generated_level(&board, size) < 0) return -1;
+    if (spawn_random_ghosts(&board, 256) < 0) {
+        fprintf(stderr, "Out of memory for the ghosts\n");
+        unload_level(&board);
+        return -1;
+    }
+
+    const int ticks = 2000;
+    int saved[LOG_N_CATEGORIES];
+    memcpy(saved, log_levels, sizeof(saved));
+
+    log_configure("movement=trace");
+    double traced = run_ghost_ticks(&board, ticks);
+    log_configure("off");
+    double silent = run_ghost_ticks(&board, ticks);
+    metrics_enable(1);
+    double measured = run_ghost_ticks(&board, ticks);
+    metrics_enable(0);
+    trace_start("/dev/null");
+    double timeline = run_ghost_ticks(&board, ticks);
+    trace_write();
+    memcpy(log_levels, saved, sizeof(saved));
+
+    printf("moves %dx%d, %d ghosts (LOG_LEVEL_MIN %d): trace on %.2f M/s, logging off %.2f M/s, "
+           "logging off + metrics %.2f M/s, logging off + timeline %.2f M/s\n",
+           size, size, board.n_ghosts, LOG_LEVEL_MIN, traced / 1e6, silent / 1e6, measured / 1e6,
+           timeline / 1e6);
+
+    unload_level(&board);
+    return 0;
+}
+
+typedef struct {
+    board_t* board;
+    int first, count;       // ghosts stepped by this thread
+    int ticks;
+} ghost_worker_t;
+
+static void* ghost_worker(void* arg) {
+    ghost_worker_t* w = (ghost_worker_t*)arg;
+    for (int t = 0; t < w->ticks; t++) {
+        for (int i = w->first; i < w->first + w->count; i++) {
+            ghost_t* ghost = &w->board->ghosts[i];
+            move_ghost(w->board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+        }
+    }
+    return NULL;
+}
+
+// Random-walk ghosts on 8 threads over a small size x size level with the lock profiler on,
+// then prints its report (heatmaps and most contended cells)
+static int bench_locks(int size) {
+    const int threads = 8;
+    board_t board;
+    memset(&board, 0, sizeof(board_t));
+    char* rows = malloc((size_t)size * size);
+    if (!rows) return -1;
+    generate_rows(rows, size, 42);
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    int result = create_level_file(path, rows, size);
+    free(rows);
+    if (result < 0) return -1;
+    board.profile_locks = 1;
+    load_level_file(&board, path, 0, 0);
+    unlink(path);
+    if (spawn_random_ghosts(&board, size * size / 16) < 0 || !board.lock_profile) {
+        fprintf(stderr, "Out of memory for the ghosts\n");
+        unload_level(&board);
+        return -1;
+    }
+
+    ghost_worker_t workers[8];
+    pthread_t tids[8];
+    int per = board.n_ghosts / threads;
+    double t0 = now_s();
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (ghost_worker_t){ &board, i * per, i == threads - 1 ? board.n_ghosts - i * per : per, 2000 };
+        pthread_create(&tids[i], NULL, ghost_worker, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    printf("locks %dx%d: %d ghosts on %d threads, %d ticks in %.1f ms\n", size, size, board.n_ghosts,
+           threads, workers[0].ticks, (now_s() - t0) * 1e3);
+
+    lock_profile_write(board.lock_profile, &board, stdout);
+    unload_level(&board);
+    return 0;
+}
+
+#define LOG_BURSTS 20
+#define LOG_BURST_LEN 500
+
+typedef struct {
+    int sync;           // use debug_sync instead of debug
+    double seconds;     // time spent inside the logging calls
+} log_worker_t;
+
+// Logs bursts of short lines like the agent threads do, sleeping between bursts so the
+// flusher keeps up, and times only the calls
+static void* log_worker(void* arg) {
+    log_worker_t* w = (log_worker_t*)arg;
+    struct timespec pause = { 0, 2 * LOG_FLUSH_MS * 1000000L };
+    for (int b = 0; b < LOG_BURSTS; b++) {
+        double t0 = now_s();
+        for (int i = 0; i < LOG_BURST_LEN; i++) {
+            if (w->sync) debug_sync("DEFAULT CHARGED MOVE - direction = %c\n", "WASD"[i & 3]);
+            else debug("DEFAULT CHARGED MOVE - direction = %c\n", "WASD"[i & 3]);
+        }
+        w->seconds += now_s() - t0;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// Times debug (per-thread rings) against debug_sync (write + flush per call) with 'threads' threads
+static int bench_log(int threads) {
+    if (threads < 1 || threads > LOG_MAX_THREADS) {
+        fprintf(stderr, "Thread count must be between 1 and %d\n", LOG_MAX_THREADS);
+        return -1;
+    }
+    log_worker_t workers[LOG_MAX_THREADS];
+    pthread_t tids[LOG_MAX_THREADS];
+    close_debug_file();
+
+    for (int sync = 1; sync >= 0; sync--) {
+        char path[] = "/tmp/pacmanist_log_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            perror("Failed to create temporary file");
+            return -1;
+        }
+        close(fd);
+        open_debug_file(path);
+
+        for (int i = 0; i < threads; i++) {
+            workers[i] = (log_worker_t){ .sync = sync };
+            pthread_create(&tids[i], NULL, log_worker, &workers[i]);
+        }
+        double total = 0;
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+            total += workers[i].seconds;
+        }
+        close_debug_file();
+        unlink(path);
+
+        int calls = threads * LOG_BURSTS * LOG_BURST_LEN;
+        printf("%s %d threads: %.0f ns per call (%d calls)\n", sync ? "debug_sync" : "debug     ",
+               threads, total / calls * 1e9, calls);
+    }
+    return 0;
+}
+
+// Times dump_board in both modes on a size x size level, writing to /dev/null through a normal
+// stdio buffer
+static int bench_dump(int size) {
+    board_t board;
+    if (load_generated_level(&board, size) < 0) return -1;
+    FILE* out = fopen("/dev/null", "w");
+    if (!out) {
+        unload_level(&board);
+        return -1;
+    }
+
+    for (int mode = DUMP_PLAIN; mode <= DUMP_RLE; mode++) {
+        double t0 = now_s();
+        long bytes = dump_board(&board, out, mode);
+        fflush(out);
+        double t = now_s() - t0;
+        printf("dump %s %dx%d: %.1f ms, %ld bytes, %.0f MB/s\n", mode == DUMP_RLE ? "rle  " : "plain",
+               size, size, t * 1e3, bytes, bytes / t / 1e6);
+    }
+
+    fclose(out);
+    unload_level(&board);
+    return 0;
+}
+
+#define SUITE_MIN_SECONDS 0.05  // each measurement repeats its operation for at least this long
+
+// One operation of the suite, called with increasing 'i' until enough time has passed
+typedef void (*suite_op_t)(board_t* board, long i);
+
+// Runs 'op' in doubling batches until SUITE_MIN_SECONDS have passed, returns ns per call
+static double suite_time(suite_op_t op, board_t* board, long* iterations) {
+    long done = 0, batch = 1;
+    double t0 = now_s(), elapsed = 0;
+    while (elapsed < SUITE_MIN_SECONDS) {
+        for (long i = 0; i < batch; i++) op(board, done + i);
+        done += batch;
+        batch *= 2;
+        elapsed = now_s() - t0;
+    }
+    *iterations = done;
+    return elapsed / done * 1e9;
+}
+
+static const char suite_dirs[] = "WASD";
+
+static void op_move_pacman(board_t* board, long i) {
+    command_t cmd = { .command = suite_dirs[(i * 7 + i / 5) & 3], .turns = 1, .turns_left = 1 };
+    move_pacman(board, 0, &cmd);
+}
+
+// One tick: every ghost takes its next (random walk) move
+static void op_move_ghost(board_t* board, long i) {
+    (void)i;
+    for (int g = 0; g < board->n_ghosts; g++) {
+        ghost_t* ghost = &board->ghosts[g];
+        move_ghost(board, g, &ghost->moves[ghost->current_move % ghost->n_moves]);
+    }
+}
+
+// One tick of charged moves, each ghost sliding in a direction that changes every tick
+static void op_move_ghost_charged(board_t* board, long i) {
+    for (int g = 0; g < board->n_ghosts; g++) {
+        move_ghost_charged(board, g, suite_dirs[(i + g) & 3]);
+    }
+}
+
+static void op_draw_board(board_t* board, long i) {
+    (void)i;
+    draw_board(board, DRAW_MENU);
+    refresh_screen();
+}
+
+static void op_print_board(board_t* board, long i) {
+    (void)i;
+    print_board(board, DUMP_PLAIN);
+}
+
+static char suite_path[64];     // file read by op_read_file and op_load_level_file
+
+static void op_read_file(board_t* board, long i) {
+    (void)i;
+    char** tokens = read_file(suite_path, board, -1);
+    for (char** t = tokens; t && *t; t++) free(*t);
+    free(tokens);
+}
+
+static void op_load_level_file(board_t* board, long i) {
+    (void)i;
+    load_level_file(board, suite_path, 0, 0);
+    unload_level(board);
+}
+
+static void suite_row(FILE* csv, const char* name, int size, int agents, suite_op_t op, board_t* board) {
+    long iterations;
+    double ns = suite_time(op, board, &iterations);
+#ifdef __OPTIMIZE__
+    const char* build = "optimized";
+#else
+    const char* build = "debug";
+#endif
+    fprintf(csv, "%s,%d,%d,%ld,%.1f,%s,%d\n", name, size, agents, iterations, ns, build, LOG_LEVEL_MIN);
+    fflush(csv);
+    fprintf(stderr, "%-20s %6d %6d %12.1f ns\n", name, size, agents, ns);
+}
+
+// Writes a ghost script of 'length' random moves to a new temporary file in suite_path
+static int write_script(int length) {
+    snprintf(suite_path, sizeof(suite_path), "/tmp/pacmanist_script_XXXXXX");
+    int fd = mkstemp(suite_path);
+    if (fd < 0) {
+        perror("Failed to create temporary file");
+        return -1;
+    }
+    FILE* f = fdopen(fd, "w");
+    fprintf(f, "PASSO 0\nPOS 1 1\n");
+    for (int i = 0; i < length; i++) fprintf(f, "%c\n", "WASDRT"[i % 6]);
+    fclose(f);
+    return 0;
+}
+
+// Times the engine functions over sizes 64, 256, ... up to 'max_size' and several agent counts,
+// one CSV line per measurement ('csv_path', or stdout for NULL) so runs of different versions can
+// be compared. draw_board renders into a curses screen whose output goes to /dev/null
+static int bench_suite(int max_size, const char* csv_path) {
+    FILE* csv = csv_path ? fopen(csv_path, "w") : stdout;
+    if (!csv) {
+        perror("Failed to create the CSV file");
+        return -1;
+    }
+    fprintf(csv, "benchmark,size,agents,iterations,ns_per_op,build,log_level_min\n");
+
+    FILE* null_out = fopen("/dev/null", "w");
+    FILE* null_in = fopen("/dev/null", "r");
+    SCREEN* screen = null_out && null_in ? newterm("xterm", null_out, null_in) : NULL;
+    if (!screen) fprintf(stderr, "No curses terminal, skipping draw_board\n");
+
+    const int agent_counts[] = { 1, 16, 256 };
+    for (int size = 64; size <= max_size; size *= 4) {
+        // loading: the script length follows the board size
+        if (write_script(size * 16) == 0) {
+            board_t board;
+            memset(&board, 0, sizeof(board_t));
+            suite_row(csv, "read_file", size * 16, 0, op_read_file, &board);
+            unlink(suite_path);
+        }
+        char* rows = malloc((size_t)size * size);
+        if (!rows) break;
+        generate_rows(rows, size, 42);
+        snprintf(suite_path, sizeof(suite_path), "/tmp/pacmanist_bench_XXXXXX");
+        int created = create_level_file(suite_path, rows, size);
+        free(rows);
+        if (created == 0) {
+            board_t board;
+            memset(&board, 0, sizeof(board_t));
+            suite_row(csv, "load_level_file", size, 0, op_load_level_file, &board);
+        }
+
+        for (size_t a = 0; created == 0 && a < sizeof(agent_counts) / sizeof(agent_counts[0]); a++) {
+            int agents = agent_counts[a];
+            board_t board;
+            memset(&board, 0, sizeof(board_t));
+            load_level_file(&board, suite_path, 0, 0);
+            if (a == 0) suite_row(csv, "move_pacman", size, 1, op_move_pacman, &board);
+            if (spawn_random_ghosts(&board, agents) == 0) {
+                suite_row(csv, "move_ghost", size, board.n_ghosts, op_move_ghost, &board);
+                suite_row(csv, "move_ghost_charged", size, board.n_ghosts, op_move_ghost_charged, &board);
+                if (screen) {
+                    resize_term(size + 6, size + 1);
+                    suite_row(csv, "draw_board", size, board.n_ghosts, op_draw_board, &board);
+                }
+                suite_row(csv, "print_board", size, board.n_ghosts, op_print_board, &board);
+            }
+            unload_level(&board);
+        }
+        if (created == 0) unlink(suite_path);
+    }
+
+    if (screen) {
+        endwin();
+        delscreen(screen);
+    }
+    if (null_out) fclose(null_out);
+    if (null_in) fclose(null_in);
+    if (csv != stdout) fclose(csv);
+    return 0;
+}
+
+// Steps a size x size level through the library API, feeding a key every few ticks
+static int bench_lib(int size) {
+    char* rows = malloc((size_t)size * size);
+    if (!rows) return -1;
+    generate_rows(rows, size, 42);
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    int created = create_level_file(path, rows, size);
+    free(rows);
+    if (created < 0) return -1;
+
+    pacmanist_t* game = pacmanist_create(path, 0);
+    unlink(path);
+    if (!game) {
+        fprintf(stderr, "pacmanist_create failed\n");
+        return -1;
+    }
+
+    const long ticks = 1000000;
+    long done = 0;
+    double t0 = now_s();
+    while (done < ticks) {
+        pacmanist_input(game, "WASD"[(done / 4) & 3]);
+        long n = pacmanist_step(game, 4);
+        if (n == 0) pacmanist_resume(game);
+        done += n > 0 ? n : 1;
+    }
+    double t = now_s() - t0;
+
+    pacmanist_info_t info;
+    pacmanist_info(game, &info);
+    printf("lib %dx%d: %ld ticks in %.1f ms (%.2f M ticks/s), pacman at (%d,%d) with %d points, %d dots left\n",
+           size, size, done, t * 1e3, done / t / 1e6, info.pacman_x, info.pacman_y, info.points, info.dots_left);
+    pacmanist_destroy(game);
+    return 0;
+}
+
+// Policy of the server benchmark: a random key every tick, from a per-session seed
+static char random_policy(pacmanist_t* game, void* ctx) {
+    (void)game;
+    return "WASD"[rand_r((unsigned int*)ctx) % 4];
+}
+
+// Hosts more and more sessions (a 64x64 level with 8 ghosts each) on one pool of 'workers'
+static int bench_server(int workers) {
+    const int size = 64, ghosts = 8;
+    const long ticks = 5000;
+    char* rows = malloc((size_t)size * size);
+    if (!rows) return -1;
+    generate_rows(rows, size, 42);
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    int created = create_level_file(path, rows, size);
+    free(rows);
+    if (created < 0) return -1;
+
+    printf("%8s %8s %10s %12s %12s %12s %12s %12s\n", "sessions", "workers", "ticks", "ticks/s",
+           "tick_p50_us", "tick_p99_us", "wait_p99_us", "wait_max_us");
+    const int counts[] = { 1, 16, 128, 512 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        int n = counts[c];
+        server_t* server = server_create(workers, SERVER_DEFAULT_BUDGET);
+        pacmanist_t** games = calloc(n, sizeof(pacmanist_t*));
+        unsigned int* seeds = calloc(n, sizeof(unsigned int));
+        if (!server || !games || !seeds) break;
+        for (int i = 0; i < n; i++) {
+            games[i] = pacmanist_create(path, 0);
+            if (!games[i]) break;
+            board_t* board = pacmanist_board(games[i]);
+            free(board->ghosts);
+            // in the bottom half, away from the pacman, so most sessions live to the end
+            spawn_ghosts_from(board, ghosts, size * size / 2, 7);
+            seeds[i] = i + 1;
+            server_add(server, games[i], ticks, random_policy, &seeds[i]);
+        }
+        server_run(server);
+
+        server_stats_t st;
+        server_stats(server, &st);
+        printf("%8d %8d %10ld %12.0f %12.2f %12.2f %12.1f %12.1f\n", st.sessions, st.workers, st.ticks,
+               st.ticks_per_second, st.tick_ns_p50 / 1e3, st.tick_ns_p99 / 1e3, st.wait_ns_p99 / 1e3,
+               st.wait_ns_max / 1e3);
+
+        for (int i = 0; i < n; i++) pacmanist_destroy(games[i]);
+        free(games);
+        free(seeds);
+        server_destroy(server);
+    }
+    unlink(path);
+    return 0;
+}
+
+// Steps a 4096x4096 level with 10k ghosts spread over it on a tile simulation of 1, 2, 4, ...
+// 'max_workers' workers, against board_tick on one thread
+static int bench_tiles(int max_workers) {
+    const int size = 4096, n_ghosts = 10000;
+    const long ticks = 200;
+    printf("%8s %10s %12s %10s\n", "workers", "ticks", "ticks/s", "speedup");
+    double base = 0;
+    for (int workers = 0; workers <= max_workers; workers = workers ? workers * 2 : 1) {
+        board_t board;
+        if (load_generated_level(&board, size) < 0) return -1;
+        free(board.ghosts);
+        if (spawn_ghosts_from(&board, n_ghosts, 0, size * size / n_ghosts) < 0) {
+            fprintf(stderr, "Out of memory for the ghosts\n");
+            unload_level(&board);
+            return -1;
+        }
+        board_seed_agents(&board, 42);
+        game_start(&board);
+
+        tile_sim_t* sim = NULL;
+        if (workers > 0 && !(sim = tiles_create(&board, DEFAULT_TILE_SIZE, workers))) {
+            fprintf(stderr, "tiles_create failed\n");
+            unload_level(&board);
+            return -1;
+        }
+        // The round ends when a ghost catches the pacman; carry on with the ghosts alone
+        long done = 0;
+        double t0 = now_s();
+        while (done < ticks) {
+            if (!game_is_running(&board)) game_start(&board);
+            if (sim) {
+                done += tiles_run(sim, ticks - done);
+            } else {
+                board_tick(&board, '\0');
+                done++;
+            }
+        }
+        double t = now_s() - t0;
+        tiles_destroy(sim);
+        unload_level(&board);
+
+        if (workers == 0) {
+            base = done / t;
+            printf("%8s %10ld %12.0f %10s\n", "serial", done, base, "1.00");
+        } else {
+            printf("%8d %10ld %12.0f %10.2f\n", workers, done, done / t, done / t / base);
+        }
+    }
+    printf("(%ld cores online)\n", sysconf(_SC_NPROCESSORS_ONLN));
+    return 0;
+}
+
+// Steps 'n_ghosts' ghosts on a 1024x1024 level with move_ghost (board_tick) and with the
+// structure-of-arrays passes of swarm_tick, and checks no ghost got lost on the way
+static int bench_swarm(int n_ghosts) {
+    const int size = 1024;
+    const long ticks = 100;
+    printf("%8s %10s %8s %12s %14s %12s\n", "engine", "ghosts", "ticks", "ms", "ns/ghost/tick", "moved/tick");
+    for (int bulk = 0; bulk < 2; bulk++) {
+        board_t board;
+        if (load_generated_level(&board, size) < 0) return -1;
+        free(board.ghosts);
+        if (spawn_ghosts_from(&board, n_ghosts, 0, size * size / n_ghosts / 2) < 0) {
+            fprintf(stderr, "Out of memory for the ghosts\n");
+            unload_level(&board);
+            return -1;
+        }
+        board_seed_agents(&board, 42);
+        game_start(&board);
+        swarm_t* swarm = NULL;
+        if (bulk && !(swarm = swarm_create(&board))) {
+            fprintf(stderr, "swarm_create failed\n");
+            unload_level(&board);
+            return -1;
+        }
+
+        // The round ends when a ghost catches the pacman; carry on with the ghosts alone
+        long moved = 0;
+        double t0 = now_s();
+        for (long t = 0; t < ticks; t++) {
+            if (!game_is_running(&board)) game_start(&board);
+            if (swarm) {
+                moved += swarm_tick(swarm, '\0');
+            } else {
+                board_tick(&board, '\0');
+            }
+        }
+        double t = now_s() - t0;
+        swarm_destroy(swarm);
+
+        int on_board = 0;
+        for (int i = 0; i < size * size; i++) on_board += board.cells[i] == 'M';
+        printf("%8s %10d %8ld %12.1f %14.2f ", bulk ? "swarm" : "move", board.n_ghosts, ticks, t * 1e3,
+               t / ticks / board.n_ghosts * 1e9);
+        if (bulk) printf("%12.0f\n", (double)moved / ticks);
+        else printf("%12s\n", "-");
+        if (on_board != board.n_ghosts) {
+            fprintf(stderr, "%d ghosts on the board, expected %d\n", on_board, board.n_ghosts);
+            unload_level(&board);
+            return -1;
+        }
+        unload_level(&board);
+    }
+    return 0;
+}
+
+#define AFFINITY_TICK_NS 1000000L   // period of the paced ticks
+#define AFFINITY_PACED_TICKS 500
+#define AFFINITY_FREE_TICKS 200
+
+typedef struct {
+    board_t* board;
+    int slot;                   // placement slot (a ghost thread)
+    int first, count;           // ghosts stepped by this thread
+    pthread_barrier_t* start;
+    uint32_t late_ns[AFFINITY_PACED_TICKS];
+    int migrations;             // changes of CPU seen between ticks
+    double free_seconds;        // time of the unpaced ticks
+} affinity_worker_t;
+
+static void step_share(affinity_worker_t* w) {
+    for (int i = w->first; i < w->first + w->count; i++) {
+        ghost_t* ghost = &w->board->ghosts[i];
+        move_ghost(w->board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+    }
+}
+
+// Ticks like a ghost thread of the game on a fixed period and records how late each wakeup is,
+// then runs as fast as it can
+static void* affinity_worker(void* arg) {
+    affinity_worker_t* w = (affinity_worker_t*)arg;
+    affinity_pin(w->slot);
+    pthread_barrier_wait(w->start);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int cpu = affinity_current_cpu();
+    for (int t = 0; t < AFFINITY_PACED_TICKS; t++) {
+        deadline.tv_nsec += AFFINITY_TICK_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        struct timespec woke;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+        long late = (woke.tv_sec - deadline.tv_sec) * 1000000000L + woke.tv_nsec - deadline.tv_nsec;
+        w->late_ns[t] = late > 0 ? (uint32_t)(late < UINT32_MAX ? late : UINT32_MAX) : 0;
+        int now = affinity_current_cpu();
+        if (now != cpu) w->migrations++;
+        cpu = now;
+        step_share(w);
+    }
+
+    pthread_barrier_wait(w->start);
+    double t0 = now_s();
+    for (int t = 0; t < AFFINITY_FREE_TICKS; t++) step_share(w);
+    w->free_seconds = now_s() - t0;
+    return NULL;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Runs 'threads' ghost threads over one shared 512x512 board under each placement policy
+// (and 'cpus', a CPU list, when given): wakeup lateness of ticks paced at 1 ms, CPU changes and
+// the move throughput of unpaced ticks
+static int bench_affinity(int threads, const char* cpus) {
+    const int size = 512, per_thread = 512;
+    const char* policies[] = { "none", "compact", "spread", cpus };
+    int n_policies = cpus ? 4 : 3;
+    if (threads < 1) return -1;
+    printf("%8s %8s %10s %10s %10s %11s %12s\n", "policy", "threads", "p50 us", "p99 us", "max us",
+           "migrations", "Mmoves/s");
+    for (int p = 0; p < n_policies; p++) {
+        if (affinity_configure(policies[p]) < 0) {
+            fprintf(stderr, "Bad placement %s\n", policies[p]);
+            return -1;
+        }
+        board_t board;
+        if (load_generated_level(&board, size) < 0) return -1;
+        free(board.ghosts);
+        if (spawn_random_ghosts(&board, threads * per_thread) < 0) {
+            fprintf(stderr, "Out of memory for the ghosts\n");
+            unload_level(&board);
+            return -1;
+        }
+        board_seed_agents(&board, 42);
+        game_start(&board);
+
+        affinity_worker_t* workers = calloc(threads, sizeof(affinity_worker_t));
+        pthread_t* tids = malloc(threads * sizeof(pthread_t));
+        uint32_t* late = malloc((size_t)threads * AFFINITY_PACED_TICKS * sizeof(uint32_t));
+        if (!workers || !tids || !late) {
+            free(workers);
+            free(tids);
+            free(late);
+            unload_level(&board);
+            return -1;
+        }
+        pthread_barrier_t start;
+        pthread_barrier_init(&start, NULL, threads);
+        int per = board.n_ghosts / threads;
+        for (int i = 0; i < threads; i++) {
+            workers[i] = (affinity_worker_t){ .board = &board, .slot = affinity_slot(AFFINITY_GHOST, i, 1),
+                                              .first = i * per, .start = &start,
+                                              .count = i == threads - 1 ? board.n_ghosts - i * per : per };
+            pthread_create(&tids[i], NULL, affinity_worker, &workers[i]);
+        }
+        int migrations = 0;
+        double slowest = 0;
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tids[i], NULL);
+            memcpy(late + (size_t)i * AFFINITY_PACED_TICKS, workers[i].late_ns, sizeof(workers[i].late_ns));
+            migrations += workers[i].migrations;
+            if (workers[i].free_seconds > slowest) slowest = workers[i].free_seconds;
+        }
+        pthread_barrier_destroy(&start);
+
+        size_t n_late = (size_t)threads * AFFINITY_PACED_TICKS;
+        qsort(late, n_late, sizeof(uint32_t), compare_u32);
+        printf("%8s %8d %10.1f %10.1f %10.1f %11d %12.2f\n", affinity_policy_name(affinity_policy()), threads,
+               late[n_late / 2] / 1e3, late[n_late * 99 / 100] / 1e3, late[n_late - 1] / 1e3, migrations,
+               (double)board.n_ghosts * AFFINITY_FREE_TICKS / slowest / 1e6);
+        free(workers);
+        free(tids);
+        free(late);
+        unload_level(&board);
+    }
+    affinity_configure("none");
+    printf("(%ld cores online)\n", sysconf(_SC_NPROCESSORS_ONLN));
+    return 0;
+}
+
+// Anonymous memory of the process backed by transparent huge pages, in MB
+static double anon_huge_mb(void) {
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return 0;
+    char line[128];
+    long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb / 1024.0;
+}
+
+// Loads one size x size level with the planes on normal pages, transparent huge pages and
+// hugetlb pages, and times random-walk ghosts spread over the whole board on one thread and on
+// 'threads' threads (each move touches the cells and mutexes of two far apart cells)
+static int bench_hugepages(int size, int threads) {
+    const int n_ghosts = 100000, ticks = 20;
+    const char* modes[] = { "off", "thp", "hugetlb" };
+    char* rows = malloc((size_t)size * size);
+    if (!rows) {
+        fprintf(stderr, "Out of memory for a %dx%d level\n", size, size);
+        return -1;
+    }
+    generate_rows(rows, size, 42);
+    char path[] = "/tmp/pacmanist_bench_XXXXXX";
+    int result = create_level_file(path, rows, size);
+    free(rows);
+    if (result < 0) return -1;
+    if (threads < 1) threads = 1;
+
+    printf("%8s %10s %10s %10s %14s %14s %9s\n", "pages", "got", "THP MB", "load ms", "moves/s 1t",
+           "moves/s Nt", "speedup");
+    double base = 0;
+    for (int m = 0; m < 3; m++) {
+        board_t board;
+        memset(&board, 0, sizeof(board_t));
+        board.huge_pages = parse_huge_pages(modes[m]);
+        double before = anon_huge_mb();
+        double t0 = now_s();
+        load_level_file(&board, path, 0, 0);
+        double load = now_s() - t0;
+        double thp = anon_huge_mb() - before;
+        free(board.ghosts);
+        if (!board.cells || spawn_ghosts_from(&board, n_ghosts, 0, size * size / n_ghosts) < 0) {
+            fprintf(stderr, "Out of memory for the level\n");
+            unload_level(&board);
+            unlink(path);
+            return -1;
+        }
+        // Stepped in random order, so consecutive moves land on unrelated pages
+        unsigned int shuffle = 42;
+        for (int i = board.n_ghosts - 1; i > 0; i--) {
+            int j = rand_r(&shuffle) % (i + 1);
+            ghost_t tmp = board.ghosts[i];
+            board.ghosts[i] = board.ghosts[j];
+            board.ghosts[j] = tmp;
+        }
+        board_seed_agents(&board, 42);
+        game_start(&board);
+
+        double single = run_ghost_ticks(&board, ticks);
+        ghost_worker_t* workers = calloc(threads, sizeof(ghost_worker_t));
+        pthread_t* tids = malloc(threads * sizeof(pthread_t));
+        int per = board.n_ghosts / threads;
+        t0 = now_s();
+        for (int i = 0; workers && tids && i < threads; i++) {
+            workers[i] = (ghost_worker_t){ &board, i * per, i == threads - 1 ? board.n_ghosts - i * per : per, ticks };
+            pthread_create(&tids[i], NULL, ghost_worker, &workers[i]);
+        }
+        for (int i = 0; workers && tids && i < threads; i++) pthread_join(tids[i], NULL);
+        double multi = (double)ticks * board.n_ghosts / (now_s() - t0);
+        free(workers);
+        free(tids);
+
+        const char* got = board.planes_hugetlb ? "hugetlb" : board.planes_mapped ? "thp" : "4k";
+        if (m == 0) base = single;
+        printf("%8s %10s %10.0f %10.1f %14.0f %14.0f %9.2f\n", modes[m], got, thp, load * 1e3, single, multi,
+               single / base);
+        unload_level(&board);
+    }
+    unlink(path);
+    printf("(%d threads, %d ghosts, %d ticks)\n", threads, n_ghosts, ticks);
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    atomic_int* stop;
+    long frames, retries;
+} spectate_worker_t;
+
+// A viewer checking the feed every millisecond
+static void* spectate_worker(void* arg) {
+    spectate_worker_t* w = (spectate_worker_t*)arg;
+    spectate_view_t view;
+    if (spectate_attach(&view, w->name) < 0) return NULL;
+    struct timespec pause = { 0, 1000000L };
+    while (!atomic_load(w->stop)) {
+        if (spectate_read(&view) > 0) w->frames++;
+        nanosleep(&pause, NULL);
+    }
+    w->retries = view.retries;
+    spectate_detach(&view);
+    return NULL;
+}
+
+// Steps a size x size level with 1000 ghosts without a feed, then publishing every tick with 0
+// and 'viewers' viewer threads reading it: tick rate, time spent in spectate_publish and frames seen
+static int bench_spectate(int size, int viewers) {
+    const long ticks = 2000;
+    char name[64];
+    snprintf(name, sizeof(name), "/pacmanist_bench_%d", (int)getpid());
+    printf("%8s %8s %12s %12s %14s %10s\n", "feed", "viewers", "ticks/s", "publish us", "frames/viewer",
+           "retries");
+    for (int run = 0; run < 3; run++) {
+        int publish = run > 0;
+        int n_viewers = run == 2 ? viewers : 0;
+        if (run == 2 && viewers < 1) break;
+        board_t board;
+        if (load_generated_level(&board, size) < 0) return -1;
+        free(board.ghosts);
+        if (spawn_random_ghosts(&board, 1000) < 0) {
+            fprintf(stderr, "Out of memory for the ghosts\n");
+            unload_level(&board);
+            return -1;
+        }
+        board_seed_agents(&board, 42);
+        game_start(&board);
+
+        spectate_feed_t feed;
+        if (publish && spectate_open(&feed, name) < 0) {
+            perror("spectate_open");
+            unload_level(&board);
+            return -1;
+        }
+        atomic_int stop = 0;
+        spectate_worker_t* workers = calloc(n_viewers > 0 ? n_viewers : 1, sizeof(spectate_worker_t));
+        pthread_t* tids = calloc(n_viewers > 0 ? n_viewers : 1, sizeof(pthread_t));
+        for (int i = 0; workers && tids && i < n_viewers; i++) {
+            workers[i] = (spectate_worker_t){ .name = name, .stop = &stop };
+            pthread_create(&tids[i], NULL, spectate_worker, &workers[i]);
+        }
+
+        // The round ends when a ghost catches the pacman; carry on with the ghosts alone
+        double in_publish = 0;
+        double t0 = now_s();
+        for (long t = 0; t < ticks; t++) {
+            if (!game_is_running(&board)) game_start(&board);
+            board_tick(&board, '\0');
+            if (publish) {
+                double p0 = now_s();
+                spectate_publish(&feed, &board);
+                in_publish += now_s() - p0;
+            }
+        }
+        double t = now_s() - t0;
+        atomic_store(&stop, 1);
+        long frames = 0, retries = 0;
+        for (int i = 0; workers && tids && i < n_viewers; i++) {
+            pthread_join(tids[i], NULL);
+            frames += workers[i].frames;
+            retries += workers[i].retries;
+        }
+        free(workers);
+        free(tids);
+        if (publish) spectate_close(&feed);
+        unload_level(&board);
+
+        printf("%8s %8d %12.0f %12.2f %14.0f %10ld\n", publish ? "shm" : "none", n_viewers, ticks / t,
+               in_publish / ticks * 1e6, n_viewers ? (double)frames / n_viewers : 0.0, retries);
+    }
+    printf("(%dx%d level, %ld ticks)\n", size, size, ticks);
+    return 0;
+}
+
+// Replays a recording (Pacmanist -i) at full speed, twice, and checks both runs end on the same board
+#define RECORD_SIZE 32
+#define RECORD_PACMANS 2
+#define RECORD_GHOSTS 8
+#define RECORD_KEYS 400     // keys pushed per round before the round is ended
+
+// Writes a level with RECORD_PACMANS typed pacmans and RECORD_GHOSTS random-walking ghosts into
+// 'dir'; 'level' gets the path of the level file
+static int write_record_level(const char* dir, char* level, size_t len) {
+    char rows[RECORD_SIZE * RECORD_SIZE];
+    generate_rows(rows, RECORD_SIZE, 42);
+    char path[512];
+    for (int p = 0; p < RECORD_PACMANS; p++) {
+        rows[RECORD_SIZE + 1 + p] = 'o';
+        snprintf(path, sizeof(path), "%s/rec_%d.p", dir, p);
+        FILE* f = fopen(path, "w");
+        if (!f) return -1;
+        fprintf(f, "PASSO 0\nPOS 1 %d\nKEYS\n", 1 + p);
+        fclose(f);
+    }
+    for (int g = 0, cell = RECORD_SIZE * RECORD_SIZE / 2; g < RECORD_GHOSTS; cell += 5) {
+        if (rows[cell] != 'o') continue;
+        snprintf(path, sizeof(path), "%s/rec_%d.m", dir, g);
+        FILE* f = fopen(path, "w");
+        if (!f) return -1;
+        fprintf(f, "PASSO %d\nPOS %d %d\nR\nR\nC\nR\n", g % 3, cell / RECORD_SIZE, cell % RECORD_SIZE);
+        fclose(f);
+        g++;
+    }
+
+    snprintf(level, len, "%s/rec.lvl", dir);
+    FILE* f = fopen(level, "w");
+    if (!f) return -1;
+    fprintf(f, "DIM %d %d\nTEMPO 1\nPAC", RECORD_SIZE, RECORD_SIZE);
+    for (int p = 0; p < RECORD_PACMANS; p++) fprintf(f, " rec_%d.p", p);
+    fprintf(f, "\nMON");
+    for (int g = 0; g < RECORD_GHOSTS; g++) fprintf(f, " rec_%d.m", g);
+    fprintf(f, "\n");
+    for (int y = 0; y < RECORD_SIZE; y++) {
+        fwrite(rows + y * RECORD_SIZE, 1, RECORD_SIZE, f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return 0;
+}
+
+typedef struct {
+    board_t* board;
+    recorder_t* recorder;
+    long ticks;
+    atomic_int end_request;     // game_state_t posted by the other thread, GAME_RUNNING for none
+} record_engine_t;
+
+// The engine thread of Pacmanist -i: recorder_tick every 'tempo' ms until the round ends, ending
+// it between two ticks when asked to
+static void* record_engine(void* arg) {
+    record_engine_t* e = (record_engine_t*)arg;
+    input_cmd_t inputs[MAX_PACMANS];
+    while (game_is_running(e->board)) {
+        game_state_t request = atomic_exchange(&e->end_request, GAME_RUNNING);
+        if (request != GAME_RUNNING) {
+            game_end(e->board, request);
+            break;
+        }
+        recorder_tick(e->recorder, e->board, inputs);
+        e->ticks++;
+        sleep_ms(e->board->tempo);
+    }
+    return NULL;
+}
+
+// Records 'rounds' rounds the way Pacmanist -i does, with keys pushed from this thread while
+// the engine thread ticks, then replays the recording: every round has to reach the board the
+// live game recorded
+static int bench_record(int rounds) {
+    char dir[] = "/tmp/pacmanist_bench_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("Failed to create temporary directory");
+        return -1;
+    }
+    char level[512], path[512];
+    snprintf(path, sizeof(path), "%s/session.rec", dir);
+    int result = write_record_level(dir, level, sizeof(level));
+
+    recorder_t recorder;
+    long keys = 0, ticks = 0;
+    if (result == 0 && recorder_open(&recorder, path, 42, -1) == 0) {
+        board_t board;
+        memset(&board, 0, sizeof(board_t));
+        board.seed = 42;
+        load_level_file(&board, level, 0, 0);
+        recorder_level(&recorder, level);
+        unsigned int seed = 7;
+        for (int r = 0; r < rounds; r++) {
+            game_start(&board);
+            record_engine_t engine = { &board, &recorder, 0, GAME_RUNNING };
+            pthread_t tid;
+            pthread_create(&tid, NULL, record_engine, &engine);
+            for (int k = 0; k < RECORD_KEYS && game_is_running(&board); k++) {
+                int p = rand_r(&seed) % RECORD_PACMANS;
+                if (input_queue_push(&board.pacmans[p].input, "WASD"[rand_r(&seed) % 4]) == 0) keys++;
+                struct timespec pause = { 0, (rand_r(&seed) % 2000) * 1000L };
+                nanosleep(&pause, NULL);
+            }
+            atomic_store(&engine.end_request, GAME_QUIT);
+            pthread_join(tid, NULL);
+            recorder_end(&recorder, &board, game_state(&board));
+            ticks += engine.ticks;
+        }
+        unload_level(&board);
+        recorder_close(&recorder);
+    } else {
+        result = -1;
+    }
+
+    replay_result_t replay;
+    if (result == 0 && replay_run(path, &replay) == 0) {
+        printf("record: %d rounds, %ld ticks, %ld keys pushed, %ld recorded\n", rounds, ticks, keys, replay.keys);
+        printf("rounds matching the recorded board: %d/%d", replay.rounds - replay.mismatches, replay.rounds);
+        if (replay.mismatches > 0) printf(" (first difference at tick %u)", replay.first_mismatch_tick);
+        printf("\n");
+        result = replay.mismatches == 0 && replay.rounds == rounds ? 0 : -1;
+    } else {
+        fprintf(stderr, "Recording failed\n");
+        result = -1;
+    }
+
+    unlink(path);
+    unlink(level);
+    for (int i = 0; i < RECORD_PACMANS || i < RECORD_GHOSTS; i++) {
+        snprintf(path, sizeof(path), "%s/rec_%d.p", dir, i);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/rec_%d.m", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    return result;
+}
+
+typedef struct {
+    board_t* board;
+    int result;
+} blocked_move_t;
+
+static void* blocked_move(void* arg) {
+    blocked_move_t* m = (blocked_move_t*)arg;
+    command_t left = { .command = 'A', .turns = 1, .turns_left = 1 };
+    m->result = move_pacman(m->board, 0, &left);
+    return NULL;
+}
+
+// Kills pacman 0 while its move is blocked on the lock of the cell it moves into, with a second
+// pacman keeping the round going: the stale move must leave the ghost and the cells alone
+static int bench_killmove(void) {
+    char dir[] = "/tmp/pacmanist_bench_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("Failed to create temporary directory");
+        return -1;
+    }
+    // XXXXXXX      pacman 0 at (2,1) moves left, the ghost at (3,1) moves left onto it and
+    // Xo0Mo1X      pacman 1 at (5,1) stays alive
+    // XXXXXXX
+    const char* files[][2] = {
+        { "kill.lvl", "DIM 7 3\nTEMPO 0\nPAC kill_0.p kill_1.p\nMON kill.m\nXXXXXXX\nXoooooX\nXXXXXXX\n" },
+        { "kill_0.p", "PASSO 0\nPOS 1 2\nKEYS\n" },
+        { "kill_1.p", "PASSO 0\nPOS 1 5\nKEYS\n" },
+        { "kill.m", "PASSO 0\nPOS 1 3\nA\nA\nA\n" },
+    };
+    char path[512];
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i][0]);
+        FILE* f = fopen(path, "w");
+        if (f) {
+            fputs(files[i][1], f);
+            fclose(f);
+        }
+    }
+    board_t board;
+    memset(&board, 0, sizeof(board_t));
+    snprintf(path, sizeof(path), "%s/kill.lvl", dir);
+    int result = load_level_file(&board, path, 0, 0);
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i][0]);
+        unlink(path);
+    }
+    rmdir(dir);
+    if (result < 0 || board.n_pacmans != 2 || board.n_ghosts != 1) {
+        fprintf(stderr, "Failed to load the killmove level\n");
+        unload_level(&board);
+        return -1;
+    }
+    game_start(&board);
+
+    int target = 1 * board.width + 1, pacman = 1 * board.width + 2;
+    pthread_mutex_lock(&board.locks[target]);
+    blocked_move_t move = { &board, -1 };
+    pthread_t tid;
+    pthread_create(&tid, NULL, blocked_move, &move);
+    struct timespec pause = { 0, 50 * 1000000L };
+    nanosleep(&pause, NULL);    // the pacman thread is now waiting for 'target'
+    move_ghost(&board, 0, &board.ghosts[0].moves[0]);
+    pthread_mutex_unlock(&board.locks[target]);
+    pthread_join(tid, NULL);
+
+    int ok = move.result == DEAD_PACMAN && board.cells[pacman] == 'M' && board.cells[target] == ' ' &&
+             board_has_dot(&board, target) && board.pacmans[0].points == 0 && game_is_running(&board);
+    printf("killmove: blocked move returned %d, cells '%c%c', dot %s, pacman 0 %d points, round %s: %s\n",
+           move.result, board.cells[target], board.cells[pacman], board_has_dot(&board, target) ? "kept" : "taken",
+           board.pacmans[0].points, game_is_running(&board) ? "running" : "over", ok ? "ok" : "CORRUPTED");
+    unload_level(&board);
+    return ok ? 0 : -1;
+}
+
+static int bench_replay(const char* path) {
+    replay_result_t runs[2];
+    double seconds[2];
+    for (int i = 0; i < 2; i++) {
+        double t0 = now_s();
+        if (replay_run(path, &runs[i]) < 0) {
+            fprintf(stderr, "%s is not a valid recording\n", path);
+            return -1;
+        }
+        seconds[i] = now_s() - t0;
+    }
+    replay_result_t* r = &runs[1];
+    printf("replay %s: %d levels, %ld ticks, %ld commands in %.1f ms (%.2f M ticks/s)\n", path, r->levels,
+           r->ticks, r->keys, seconds[1] * 1e3, seconds[1] > 0 ? r->ticks / seconds[1] / 1e6 : 0.0);
+    printf("rounds matching the recorded board: %d/%d", r->rounds - r->mismatches, r->rounds);
+    if (r->mismatches > 0) printf(" (first difference at tick %u)", r->first_mismatch_tick);
+    printf("\nfinal digest %016llx, %s between runs\n", (unsigned long long)r->digest,
+           runs[0].digest == runs[1].digest ? "identical" : "DIFFERENT");
+    return runs[0].digest == runs[1].digest ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("Usage: %s load|snapshot|rewind|log|moves|locks|dump [size|threads]\n       %s suite [max size] [csv file]\n       %s replay <record file>\n       %s record [rounds]\n       %s killmove\n       %s lib [size]\n       %s server|tiles [workers]\n       %s swarm [ghosts]\n       %s affinity [threads] [cpu list]\n       %s hugepages [size] [threads]\n       %s spectate [size] [viewers]\n",
+               argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    open_debug_file("/dev/null");
+
+    int result = -1;
+    if (strcmp(argv[1], "load") == 0) {
+        result = bench_load(argc > 2 ? atoi(argv[2]) : 8192);
+    } else if (strcmp(argv[1], "snapshot") == 0) {
+        result = bench_snapshot(argc > 2 ? atoi(argv[2]) : 4096);
+    } else if (strcmp(argv[1], "rewind") == 0) {
+        result = bench_rewind(argc > 2 ? atoi(argv[2]) : 512, 256);
+    } else if (strcmp(argv[1], "moves") == 0) {
+        result = bench_moves(argc > 2 ? atoi(argv[2]) : 512);
+    } else if (strcmp(argv[1], "locks") == 0) {
+        result = bench_locks(argc > 2 ? atoi(argv[2]) : 32);
+    } else if (strcmp(argv[1], "server") == 0) {
+        result = bench_server(argc > 2 ? atoi(argv[2]) : 4);
+    } else if (strcmp(argv[1], "tiles") == 0) {
+        result = bench_tiles(argc > 2 ? atoi(argv[2]) : 8);
+    } else if (strcmp(argv[1], "swarm") == 0) {
+        result = bench_swarm(argc > 2 ? atoi(argv[2]) : 100000);
+    } else if (strcmp(argv[1], "affinity") == 0) {
+        result = bench_affinity(argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN), argc > 3 ? argv[3] : NULL);
+    } else if (strcmp(argv[1], "hugepages") == 0) {
+        result = bench_hugepages(argc > 2 ? atoi(argv[2]) : 4096, argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    } else if (strcmp(argv[1], "spectate") == 0) {
+        result = bench_spectate(argc > 2 ? atoi(argv[2]) : 256, argc > 3 ? atoi(argv[3]) : 4);
+    } else if (strcmp(argv[1], "lib") == 0) {
+        result = bench_lib(argc > 2 ? atoi(argv[2]) : 64);
+    } else if (strcmp(argv[1], "killmove") == 0) {
+        result = bench_killmove();
+    } else if (strcmp(argv[1], "record") == 0) {
+        result = bench_record(argc > 2 ? atoi(argv[2]) : 3);
+    } else if (strcmp(argv[1], "replay") == 0 && argc > 2) {
+        result = bench_replay(argv[2]);
+    } else if (strcmp(argv[1], "suite") == 0) {
+        result = bench_suite(argc > 2 ? atoi(argv[2]) : 1024, argc > 3 ? argv[3] : NULL);
+    } else if (strcmp(argv[1], "dump") == 0) {
+        result = bench_dump(argc > 2 ? atoi(argv[2]) : 4096);
+    } else if (strcmp(argv[1], "log") == 0) {
+        result = bench_log(argc > 2 ? atoi(argv[2]) : 4);
+    } else {
+        fprintf(stderr, "Unknown benchmark: %s\n", argv[1]);
+    }
+
+    close_debug_file();
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
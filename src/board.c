@@ -1,4 +1,9 @@
+#define _DEFAULT_SOURCE     // MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE
 #include "board.h"
+#include "row_decoder.h"
+#include "metrics.h"
+#include "lock_profile.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
@@ -9,29 +14,57 @@
 #include <libgen.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <sys/mman.h>
 
 #define STRIDE 4096
+#define DOT_WORDS(cells) (((cells) + 63) / 64)
+
+static _Thread_local uint64_t locked_at_ns; // when lock_positions returned, for the hold time metric
+
+// Bloqueia o mutex de uma célula, medindo a espera e o tempo em posse quando há perfil dos locks
+static void lock_cell(board_t* board, int idx) {
+    if (board->tile_owned) return;
+    if (board->lock_profile) {
+        lock_profile_acquire(board->lock_profile, &board->locks[idx], idx);
+    } else if (!trace_on()) {
+        pthread_mutex_lock(&board->locks[idx]);
+    } else if (pthread_mutex_trylock(&board->locks[idx]) != 0) {
+        // Só as esperas reais aparecem na timeline
+        uint64_t span = trace_begin();
+        pthread_mutex_lock(&board->locks[idx]);
+        trace_end("lock_wait", span, idx);
+    }
+}
 
-FILE * debugfile;
+static void unlock_cell(board_t* board, int idx) {
+    if (board->tile_owned) return;
+    if (board->lock_profile) lock_profile_release(board->lock_profile, &board->locks[idx], idx);
+    else pthread_mutex_unlock(&board->locks[idx]);
+}
 
 // Bloqueia dois mutexes numa ordem fixa (baseada no índice) para evitar Deadlocks
 static void lock_positions(board_t* board, int idx1, int idx2) {
     if (idx1 == idx2) {
-        pthread_mutex_lock(&board->board[idx1].mutex);
+        lock_cell(board, idx1);
     } else if (idx1 < idx2) {
-        pthread_mutex_lock(&board->board[idx1].mutex);
-        pthread_mutex_lock(&board->board[idx2].mutex);
+        lock_cell(board, idx1);
+        lock_cell(board, idx2);
     } else {
-        pthread_mutex_lock(&board->board[idx2].mutex);
-        pthread_mutex_lock(&board->board[idx1].mutex);
+        lock_cell(board, idx2);
+        lock_cell(board, idx1);
     }
+    locked_at_ns = metrics_sample() ? now_ns() : 0;
 }
 
 // Desbloqueia os mutexes das posições
 static void unlock_positions(board_t* board, int idx1, int idx2) {
-    pthread_mutex_unlock(&board->board[idx1].mutex);
+    if (locked_at_ns) {
+        metric_record(METRIC_HIST_LOCK_HOLD_NS, now_ns() - locked_at_ns);
+        locked_at_ns = 0;
+    }
+    unlock_cell(board, idx1);
     if (idx1 != idx2) {
-        pthread_mutex_unlock(&board->board[idx2].mutex);
+        unlock_cell(board, idx2);
     }
 }
 
@@ -40,8 +73,7 @@ static void unlock_positions(board_t* board, int idx1, int idx2) {
 static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
     for (int p = 0; p < board->n_pacmans; p++) {
         pacman_t* pac = &board->pacmans[p];
-        if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-            pac->alive = 0;
+        if (pac->pos_x == new_x && pac->pos_y == new_y && atomic_load_explicit(&pac->alive, memory_order_acquire)) {
             kill_pacman(board, p);
             return DEAD_PACMAN;
         }
@@ -59,15 +91,261 @@ static inline int is_valid_position(board_t* board, int x, int y) {
     return (x >= 0 && x < board->width) && (y >= 0 && y < board->height); 
 }
 
+// Helper private function for signalling that something visible on the board changed.
+// Tile workers skip it (one shared counter bumped by every move would bounce between cores);
+// tiles_tick bumps it once per tick instead
+static inline void mark_changed(board_t* board) {
+    if (board->tile_owned) return;
+    atomic_fetch_add_explicit(&board->version, 1, memory_order_release);
+}
+
+// Helper private function for setting a bit of a board bitset while loading (single-threaded)
+static inline void set_bit(uint64_t* set, int index) {
+    set[index >> 6] |= UINT64_C(1) << (index & 63);
+}
+
+// Helper private function for passing a delta to every registered hook
+static void emit_delta(board_t* board, board_delta_t* delta) {
+    delta->tick = atomic_load_explicit(&board->tick, memory_order_relaxed);
+    for (int i = 0; i < board->n_delta_hooks; i++) {
+        board->delta_hooks[i](board->delta_ctx[i], delta);
+    }
+}
+
+// Helper private function for changing a cell during play (the caller holds the cell lock)
+static inline void set_cell(board_t* board, int index, char content) {
+    if (board->n_delta_hooks > 0 && board->cells[index] != content) {
+        board_delta_t delta = { .kind = DELTA_CELL, .index = index,
+                                .old_cell = board->cells[index], .new_cell = content };
+        emit_delta(board, &delta);
+    }
+    board->cells[index] = content;
+}
+
+// Helper private function for collecting a dot, returns 1 if it was still there.
+// Cells sharing a bitset word are guarded by different mutexes, so the clear must be atomic
+static inline int take_dot(board_t* board, int index) {
+    uint64_t mask = UINT64_C(1) << (index & 63);
+    int taken = (__atomic_fetch_and(&board->dots[index >> 6], ~mask, __ATOMIC_RELAXED) & mask) != 0;
+    if (taken && board->n_delta_hooks > 0) {
+        board_delta_t delta = { .kind = DELTA_DOT, .index = index };
+        emit_delta(board, &delta);
+    }
+    return taken;
+}
+
+// Helper private function for recording the part of a pacman a step can change
+static void capture_pacman(pacman_t* pac, int cmd_index, agent_state_t* state) {
+    memset(state, 0, sizeof(agent_state_t));
+    state->pos_x = pac->pos_x;
+    state->pos_y = pac->pos_y;
+    state->points = pac->points;
+    state->current_move = pac->current_move;
+    state->waiting = pac->waiting;
+    state->cmd_index = cmd_index;
+    state->cmd_turns_left = cmd_index >= 0 ? pac->moves[cmd_index].turns_left : 0;
+    state->alive = atomic_load(&pac->alive);
+    state->rng = pac->rng;
+}
+
+// Helper private function for recording the part of a ghost a step can change
+static void capture_ghost(ghost_t* ghost, int cmd_index, agent_state_t* state) {
+    memset(state, 0, sizeof(agent_state_t));
+    state->pos_x = ghost->pos_x;
+    state->pos_y = ghost->pos_y;
+    state->current_move = ghost->current_move;
+    state->waiting = ghost->waiting;
+    state->cmd_index = cmd_index;
+    state->cmd_turns_left = cmd_index >= 0 ? ghost->moves[cmd_index].turns_left : 0;
+    state->charged = ghost->charged;
+    state->rng = ghost->rng;
+}
+
+// Helper private function for finding which script command (if any) 'command' is
+static inline int script_index(command_t* moves, command_t* command) {
+    return (command >= moves && command < moves + MAX_MOVES) ? (int)(command - moves) : -1;
+}
+
+// Bits of board->planes_mapped and board->planes_hugetlb
+#define PLANE_CELLS 1
+#define PLANE_LOCKS 2
+#define PLANE_DOTS 4
+#define PLANE_PORTALS 8
+
+// Default huge page size from /proc/meminfo, 2 MB when it cannot be read
+static size_t huge_page_size(void) {
+    static size_t size;
+    if (size) return size;
+    size = 2 << 20;
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (!f) return size;
+    char line[128];
+    long kb;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Hugepagesize: %ld kB", &kb) == 1 && kb > 0) size = (size_t)kb << 10;
+    }
+    fclose(f);
+    return size;
+}
+
+static size_t plane_length(size_t bytes) {
+    size_t huge = huge_page_size();
+    return (bytes + huge - 1) / huge * huge;
+}
+
+// Zeroed memory for one plane. With board->huge_pages set, a plane of a huge page or more is
+// mapped directly: from the hugetlb pool, else aligned and madvised for transparent huge pages,
+// else (no mmap) from calloc like smaller planes
+static void* alloc_plane(board_t* board, size_t bytes, int plane) {
+    size_t huge = huge_page_size();
+    if (board->huge_pages == HUGE_PAGES_OFF || bytes < huge) return calloc(bytes, 1);
+    size_t len = plane_length(bytes);
+#ifdef MAP_HUGETLB
+    if (board->huge_pages == HUGE_PAGES_HUGETLB) {
+        void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            board->planes_mapped |= plane;
+            board->planes_hugetlb |= plane;
+            return p;
+        }
+        log_debug(LOG_CAT_LOADER, "No hugetlb pages for %zu MB, trying transparent huge pages\n", len >> 20);
+    }
+#endif
+    // One huge page more than needed, then the ends are cut so the plane starts on a boundary
+    char* raw = mmap(NULL, len + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return calloc(bytes, 1);
+    char* p = (char*)(((uintptr_t)raw + huge - 1) & ~(uintptr_t)(huge - 1));
+    if (p > raw) munmap(raw, p - raw);
+    munmap(p + len, raw + huge - p);
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, len, MADV_HUGEPAGE) < 0) {
+        log_debug(LOG_CAT_LOADER, "Transparent huge pages unavailable, using normal pages\n");
+    }
+#endif
+    board->planes_mapped |= plane;
+    return p;
+}
+
+int parse_huge_pages(const char* name) {
+    if (strcmp(name, "off") == 0) return HUGE_PAGES_OFF;
+    if (strcmp(name, "thp") == 0) return HUGE_PAGES_THP;
+    if (strcmp(name, "hugetlb") == 0) return HUGE_PAGES_HUGETLB;
+    return -1;
+}
+
+static void free_plane(board_t* board, void* p, size_t bytes, int plane) {
+    if (board->planes_mapped & plane) munmap(p, plane_length(bytes));
+    else free(p);
+}
+
+// Allocates the board planes (cells, locks, dots and portals) for board->width x board->height
+static int alloc_board(board_t* board) {
+    int cells = board->width * board->height;
+    board->planes_mapped = 0;
+    board->planes_hugetlb = 0;
+    board->cells = alloc_plane(board, (size_t)cells, PLANE_CELLS);
+    board->locks = alloc_plane(board, (size_t)cells * sizeof(pthread_mutex_t), PLANE_LOCKS);
+    board->dots = alloc_plane(board, DOT_WORDS((size_t)cells) * sizeof(uint64_t), PLANE_DOTS);
+    board->portals = alloc_plane(board, DOT_WORDS((size_t)cells) * sizeof(uint64_t), PLANE_PORTALS);
+    if (!board->cells || !board->locks || !board->dots || !board->portals) {
+        return -1;
+    }
+    for (int i = 0; i < cells; i++) {
+        pthread_mutex_init(&board->locks[i], NULL);
+    }
+    if (board->profile_locks) {
+        board->lock_profile = lock_profile_create(board->width, board->height);
+    }
+    if (board->planes_mapped) {
+        log_info(LOG_CAT_LOADER, "Board planes on huge pages: %s%s%s%s(%s)\n",
+                 board->planes_mapped & PLANE_CELLS ? "cells " : "", board->planes_mapped & PLANE_LOCKS ? "locks " : "",
+                 board->planes_mapped & PLANE_DOTS ? "dots " : "", board->planes_mapped & PLANE_PORTALS ? "portals " : "",
+                 board->planes_hugetlb ? "hugetlb" : "transparent");
+    }
+    return 0;
+}
+
+// Resets the dot counters once the board and agents are loaded
+static void reset_dot_count(board_t* board) {
+    board->total_dots = count_dots(board);
+    atomic_store(&board->dots_left, board->total_dots);
+}
+
+int board_has_dot(board_t* board, int index) {
+    return (__atomic_load_n(&board->dots[index >> 6], __ATOMIC_RELAXED) >> (index & 63)) & 1;
+}
+
+int board_has_portal(board_t* board, int index) {
+    return (board->portals[index >> 6] >> (index & 63)) & 1;
+}
+
+int count_dots(board_t* board) {
+    if (!board->dots) return 0;
+    int words = DOT_WORDS(board->width * board->height);
+    int n = 0;
+    for (int i = 0; i < words; i++) {
+        n += __builtin_popcountll(__atomic_load_n(&board->dots[i], __ATOMIC_RELAXED));
+    }
+    return n;
+}
+
+void game_start(board_t* board) {
+    atomic_store_explicit(&board->state, GAME_RUNNING, memory_order_release);
+}
+
+int game_end(board_t* board, game_state_t reason) {
+    int expected = GAME_RUNNING;
+    return atomic_compare_exchange_strong_explicit(&board->state, &expected, reason,
+                                                   memory_order_acq_rel, memory_order_acquire);
+}
+
+game_state_t game_state(board_t* board) {
+    return atomic_load_explicit(&board->state, memory_order_acquire);
+}
+
+int game_is_running(board_t* board) {
+    return game_state(board) == GAME_RUNNING;
+}
+
 void sleep_ms(int milliseconds) {
+    uint64_t span = trace_begin();
     struct timespec ts;
     ts.tv_sec = milliseconds / 1000;
     ts.tv_nsec = (milliseconds % 1000) * 1000000;
     nanosleep(&ts, NULL);
+    trace_end("sleep", span, -1);
 }
 
-int move_pacman(board_t* board, int pacman_index, command_t* command) {
-    if (pacman_index < 0 || !board->pacmans[pacman_index].alive) {
+// splitmix64 of (seed, agent), so neighbouring agents get unrelated streams; xorshift32 needs a
+// non-zero state
+static uint32_t agent_seed(uint64_t seed, int agent) {
+    uint64_t z = seed + (uint64_t)(agent + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)(z ^ (z >> 31)) | 1;
+}
+
+void board_seed_agents(board_t* board, uint64_t seed) {
+    board->seed = seed;
+    for (int i = 0; i < board->n_pacmans; i++) board->pacmans[i].rng = agent_seed(seed, i);
+    for (int i = 0; i < board->n_ghosts; i++) board->ghosts[i].rng = agent_seed(seed, MAX_PACMANS + i);
+}
+
+// Next 'R' direction of an agent: one xorshift32 step, the top two bits pick the direction (the
+// same draw as the swarm's plan pass)
+static char random_direction(uint32_t* state) {
+    static const char directions[] = {'W', 'S', 'A', 'D'};
+    uint32_t r = *state;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    *state = r;
+    return directions[r >> 30];
+}
+
+// Helper private function with the pacman step itself, see move_pacman
+static int step_pacman(board_t* board, int pacman_index, command_t* command) {
+    if (pacman_index < 0 || !atomic_load_explicit(&board->pacmans[pacman_index].alive, memory_order_acquire)) {
         return DEAD_PACMAN; // Invalid or dead pacman
     }
 
@@ -84,8 +362,7 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
     char direction = command->command;
 
     if (direction == 'R') {
-        char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = random_direction(&pac->rng);
     }
 
     // Calculate new position based on direction
@@ -123,12 +400,19 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     int new_index = get_board_index(board, new_x, new_y);
     int old_index = get_board_index(board, pac->pos_x, pac->pos_y);
-    char target_content = board->board[new_index].content;
 
     lock_positions(board, old_index, new_index);
+    // A ghost may have killed this pacman while it waited for the locks: its old cell is no
+    // longer its own and the other pacmans play on
+    if (!atomic_load_explicit(&pac->alive, memory_order_acquire)) {
+        unlock_positions(board, old_index, new_index);
+        return DEAD_PACMAN;
+    }
+    // Read under the lock: another agent may be moving into the cell right now
+    char target_content = board->cells[new_index];
 
-    // Check for walls
-    if (target_content == 'W') {
+    // Check for walls and other pacmans
+    if (target_content == 'W' || target_content == 'P') {
         unlock_positions(board, old_index, new_index);
         return INVALID_MOVE;
     }
@@ -140,29 +424,33 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
         return DEAD_PACMAN;
     }
 
-    if (board->board[new_index].has_portal) {
-        board->board[old_index].content = ' ';
-        board->board[new_index].content = 'P';
+    if (board_has_portal(board, new_index)) {
+        if (board->cells[old_index] == 'P') set_cell(board, old_index, ' ');
+        set_cell(board, new_index, 'P');
         pac->pos_x = new_x;
         pac->pos_y = new_y;
+        mark_changed(board);
         unlock_positions(board, old_index, new_index);
         return REACHED_PORTAL;
     }
 
     // Collect points
-    if (board->board[new_index].has_dot) {
+    int cleared = 0;
+    if (take_dot(board, new_index)) {
         pac->points++;
-        board->board[new_index].has_dot = 0;
+        // The last dot finishes the level when the level asks for it
+        cleared = atomic_fetch_sub(&board->dots_left, 1) == 1 && board->win_on_clear;
     }
 
-    board->board[old_index].content = ' ';
+    if (board->cells[old_index] == 'P') set_cell(board, old_index, ' ');
     pac->pos_x = new_x;
     pac->pos_y = new_y;
-    board->board[new_index].content = 'P';
+    set_cell(board, new_index, 'P');
+    mark_changed(board);
 
     unlock_positions(board, old_index, new_index);
 
-    return VALID_MOVE;
+    return cleared ? REACHED_PORTAL : VALID_MOVE;
 }
 
 // Helper private function for charged ghost movement in one direction
@@ -174,19 +462,19 @@ static int move_ghost_charged_direction(board_t* board, ghost_t* ghost, char dir
     
     #define CHECK_CELL_SAFE(cx, cy) \
         int idx = get_board_index(board, cx, cy); \
-        pthread_mutex_lock(&board->board[idx].mutex); \
-        char t_content = board->board[idx].content; \
+        lock_cell(board, idx); \
+        char t_content = board->cells[idx]; \
         if (t_content == 'W' || t_content == 'M') { \
-            pthread_mutex_unlock(&board->board[idx].mutex); \
+            unlock_cell(board, idx); \
             return VALID_MOVE;  \
         } \
         if (t_content == 'P') { \
             *new_x = cx; *new_y = cy; \
             int res = find_and_kill_pacman(board, cx, cy); \
-            pthread_mutex_unlock(&board->board[idx].mutex); \
+            unlock_cell(board, idx); \
             return res; \
         } \
-        pthread_mutex_unlock(&board->board[idx].mutex);
+        unlock_cell(board, idx);
 
     switch (direction) {
         case 'W': // Cima
@@ -218,7 +506,7 @@ static int move_ghost_charged_direction(board_t* board, ghost_t* ghost, char dir
             }
             break;
         default:
-            debug("DEFAULT CHARGED MOVE - direction = %c\n", direction);
+            log_debug(LOG_CAT_MOVEMENT, "DEFAULT CHARGED MOVE - direction = %c\n", direction);
             return INVALID_MOVE;
     }
     return VALID_MOVE;
@@ -234,7 +522,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     ghost->charged = 0; //uncharge
     int result = move_ghost_charged_direction(board, ghost, direction, &new_x, &new_y);
     if (result == INVALID_MOVE) {
-        debug("DEFAULT CHARGED MOVE - direction = %c\n", direction);
+        log_debug(LOG_CAT_MOVEMENT, "DEFAULT CHARGED MOVE - direction = %c\n", direction);
         return INVALID_MOVE;
     }
 
@@ -245,19 +533,21 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     lock_positions(board, old_index, new_index);
 
     // Update board - clear old position (restore what was there)
-    board->board[old_index].content = ' '; // Or restore the dot if ghost was on one
+    set_cell(board, old_index, ' '); // Or restore the dot if ghost was on one
     // Update ghost position
     ghost->pos_x = new_x;
     ghost->pos_y = new_y;
     // Update board - set new position
-    board->board[new_index].content = 'M';
+    set_cell(board, new_index, 'M');
+    mark_changed(board);
 
     unlock_positions(board, old_index, new_index);
 
     return result;
 }
 
-int move_ghost(board_t* board, int ghost_index, command_t* command) {
+// Helper private function with the ghost step itself, see move_ghost
+static int step_ghost(board_t* board, int ghost_index, command_t* command) {
     ghost_t* ghost = &board->ghosts[ghost_index];
     int new_x = ghost->pos_x;
     int new_y = ghost->pos_y;
@@ -272,8 +562,7 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     char direction = command->command;
     
     if (direction == 'R') {
-        char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = random_direction(&ghost->rng);
     }
 
     // Calculate new position based on direction
@@ -293,6 +582,7 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
         case 'C': // Charge
             ghost->current_move += 1;
             ghost->charged = 1;
+            mark_changed(board);
             return VALID_MOVE;
         case 'T': // Wait
             if (command->turns_left == 1) {
@@ -318,9 +608,9 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     // Check board position
     int new_index = get_board_index(board, new_x, new_y);
     int old_index = get_board_index(board, ghost->pos_x, ghost->pos_y);
-    char target_content = board->board[new_index].content;
 
     lock_positions(board, old_index, new_index);
+    char target_content = board->cells[new_index];
 
     // Check for walls and ghosts
     if (target_content == 'W' || target_content == 'M') {
@@ -335,28 +625,238 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     }
 
     // Update board - clear old position (restore what was there)
-    board->board[old_index].content = ' '; // Or restore the dot if ghost was on one
+    set_cell(board, old_index, ' '); // Or restore the dot if ghost was on one
     // Update ghost position
     ghost->pos_x = new_x;
     ghost->pos_y = new_y;
     // Update board - set new position
-    board->board[new_index].content = 'M';
+    set_cell(board, new_index, 'M');
+    mark_changed(board);
 
     unlock_positions(board, old_index, new_index);
 
     return result;
 }
 
+// Runs a move and, when a delta hook is installed, emits the agent's state before and after it
+static int pacman_step_with_delta(board_t* board, int pacman_index, command_t* command) {
+    pacman_t* pac = &board->pacmans[pacman_index];
+    board_delta_t delta = { .kind = DELTA_PACMAN, .index = pacman_index };
+    int cmd_index = script_index(pac->moves, command);
+
+    capture_pacman(pac, cmd_index, &delta.before);
+    int result = step_pacman(board, pacman_index, command);
+    capture_pacman(pac, cmd_index, &delta.after);
+
+    if (memcmp(&delta.before, &delta.after, sizeof(agent_state_t)) != 0) {
+        emit_delta(board, &delta);
+    }
+    return result;
+}
+
+static int ghost_step_with_delta(board_t* board, int ghost_index, command_t* command) {
+    ghost_t* ghost = &board->ghosts[ghost_index];
+    board_delta_t delta = { .kind = DELTA_GHOST, .index = ghost_index };
+    int cmd_index = script_index(ghost->moves, command);
+
+    capture_ghost(ghost, cmd_index, &delta.before);
+    int result = step_ghost(board, ghost_index, command);
+    capture_ghost(ghost, cmd_index, &delta.after);
+
+    if (memcmp(&delta.before, &delta.after, sizeof(agent_state_t)) != 0) {
+        emit_delta(board, &delta);
+    }
+    return result;
+}
+
+// Move metrics, 'start' is 0 when this move was not sampled for the time histogram
+static void count_move(metric_counter_t kind, uint64_t start, int result) {
+    if (start) metric_record(METRIC_HIST_MOVE_NS, now_ns() - start);
+    metric_count(kind, 1);
+    if (result == INVALID_MOVE) metric_count(METRIC_INVALID_MOVES, 1);
+}
+
+int move_pacman(board_t* board, int pacman_index, command_t* command) {
+    uint64_t span = trace_begin();
+    uint64_t start = metrics_sample() ? now_ns() : 0;
+    int result;
+    if (board->n_delta_hooks == 0 || pacman_index < 0) {
+        result = step_pacman(board, pacman_index, command);
+    } else {
+        result = pacman_step_with_delta(board, pacman_index, command);
+    }
+    if (metrics_on()) count_move(METRIC_PACMAN_MOVES, start, result);
+    trace_end("move_pacman", span, pacman_index);
+    log_trace(LOG_CAT_MOVEMENT, "Pacman %d %c -> %d\n", pacman_index, command->command, result);
+    return result;
+}
+
+int move_ghost(board_t* board, int ghost_index, command_t* command) {
+    uint64_t span = trace_begin();
+    uint64_t start = metrics_sample() ? now_ns() : 0;
+    int result;
+    if (board->n_delta_hooks == 0) {
+        result = step_ghost(board, ghost_index, command);
+    } else {
+        result = ghost_step_with_delta(board, ghost_index, command);
+    }
+    if (metrics_on()) count_move(METRIC_GHOST_MOVES, start, result);
+    trace_end("move_ghost", span, ghost_index);
+    log_trace(LOG_CAT_MOVEMENT, "Ghost %d %c -> (%d,%d) %d\n", ghost_index, command->command,
+              board->ghosts[ghost_index].pos_x, board->ghosts[ghost_index].pos_y, result);
+    return result;
+}
+
+void board_tick_pacmans(board_t* board, const char* keys) {
+    for (int p = 0; p < board->n_pacmans && game_is_running(board); p++) {
+        pacman_t* pac = &board->pacmans[p];
+        if (!atomic_load(&pac->alive)) continue;
+        command_t typed = { .command = keys ? keys[p] : '\0', .turns = 1, .turns_left = 0 };
+        command_t* cmd = pac->n_moves > 0 ? &pac->moves[pac->current_move % pac->n_moves] : &typed;
+        if (cmd->command != '\0' && move_pacman(board, p, cmd) == REACHED_PORTAL) {
+            game_end(board, GAME_PORTAL_REACHED);
+        }
+    }
+    atomic_fetch_add(&board->tick, 1);
+}
+
+void board_tick_keys(board_t* board, const char* keys) {
+    board_tick_pacmans(board, keys);
+    for (int i = 0; i < board->n_ghosts && game_is_running(board); i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        move_ghost(board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+    }
+}
+
+void board_tick(board_t* board, char key) {
+    char keys[MAX_PACMANS] = { key };
+    board_tick_keys(board, keys);
+}
+
+// Keys of each player in the order up, left, down, right
+static const char player_keys[MAX_PLAYERS][4] = { {'W', 'A', 'S', 'D'}, {'I', 'J', 'K', 'L'}, {'8', '4', '5', '6'} };
+
+const char* player_keys_of(int player) {
+    return player >= 0 && player < MAX_PLAYERS ? player_keys[player] : NULL;
+}
+
+int pacman_for_key(board_t* board, char key, char* command) {
+    for (int p = 0; p < board->n_pacmans; p++) {
+        pacman_t* pac = &board->pacmans[p];
+        if (pac->n_moves > 0 || pac->player < 0 || pac->player >= MAX_PLAYERS) continue;
+        for (int k = 0; k < 4; k++) {
+            if (player_keys[pac->player][k] == key) {
+                *command = "WASD"[k];
+                return p;
+            }
+        }
+    }
+    return -1;
+}
+
+int first_alive_pacman(board_t* board) {
+    for (int p = 0; p < board->n_pacmans; p++) {
+        if (atomic_load(&board->pacmans[p].alive)) return p;
+    }
+    return -1;
+}
+
+int add_delta_hook(board_t* board, delta_hook_t hook, void* ctx) {
+    if (board->n_delta_hooks >= MAX_DELTA_HOOKS) {
+        return -1;
+    }
+    board->delta_hooks[board->n_delta_hooks] = hook;
+    board->delta_ctx[board->n_delta_hooks] = ctx;
+    board->n_delta_hooks++;
+    return 0;
+}
+
+void remove_delta_hook(board_t* board, delta_hook_t hook, void* ctx) {
+    for (int i = 0; i < board->n_delta_hooks; i++) {
+        if (board->delta_hooks[i] == hook && board->delta_ctx[i] == ctx) {
+            for (int j = i + 1; j < board->n_delta_hooks; j++) {
+                board->delta_hooks[j - 1] = board->delta_hooks[j];
+                board->delta_ctx[j - 1] = board->delta_ctx[j];
+            }
+            board->n_delta_hooks--;
+            return;
+        }
+    }
+}
+
+// Helper private function for writing an agent state back
+static void restore_agent(int* pos_x, int* pos_y, int* current_move, int* waiting,
+                          command_t* moves, const agent_state_t* state) {
+    *pos_x = state->pos_x;
+    *pos_y = state->pos_y;
+    *current_move = state->current_move;
+    *waiting = state->waiting;
+    if (state->cmd_index >= 0) {
+        moves[state->cmd_index].turns_left = state->cmd_turns_left;
+    }
+}
+
+void apply_delta(board_t* board, const board_delta_t* delta, int undo) {
+    uint64_t mask = UINT64_C(1) << (delta->index & 63);
+
+    switch (delta->kind) {
+        case DELTA_CELL:
+            board->cells[delta->index] = undo ? delta->old_cell : delta->new_cell;
+            break;
+        case DELTA_DOT:
+            if (undo) {
+                board->dots[delta->index >> 6] |= mask;
+                atomic_fetch_add(&board->dots_left, 1);
+            } else {
+                board->dots[delta->index >> 6] &= ~mask;
+                atomic_fetch_sub(&board->dots_left, 1);
+            }
+            break;
+        case DELTA_PACMAN: {
+            pacman_t* pac = &board->pacmans[delta->index];
+            const agent_state_t* state = undo ? &delta->before : &delta->after;
+            restore_agent(&pac->pos_x, &pac->pos_y, &pac->current_move, &pac->waiting, pac->moves, state);
+            pac->points = state->points;
+            pac->rng = state->rng;
+            atomic_store(&pac->alive, state->alive);
+            break;
+        }
+        case DELTA_GHOST: {
+            ghost_t* ghost = &board->ghosts[delta->index];
+            const agent_state_t* state = undo ? &delta->before : &delta->after;
+            restore_agent(&ghost->pos_x, &ghost->pos_y, &ghost->current_move, &ghost->waiting, ghost->moves, state);
+            ghost->charged = state->charged;
+            ghost->rng = state->rng;
+            break;
+        }
+    }
+    atomic_fetch_add(&board->version, 1);
+}
+
 void kill_pacman(board_t* board, int pacman_index) {
-    debug("Killing %d pacman\n\n", pacman_index);
+    log_info(LOG_CAT_MOVEMENT, "Killing %d pacman\n\n", pacman_index);
+    metric_count(METRIC_DEATHS, 1);
     pacman_t* pac = &board->pacmans[pacman_index];
+    board_delta_t delta = { .kind = DELTA_PACMAN, .index = pacman_index };
+    if (board->n_delta_hooks > 0) {
+        capture_pacman(pac, -1, &delta.before);
+    }
     int index = pac->pos_y * board->width + pac->pos_x;
 
     // Remove pacman from the board
-    board->board[index].content = ' ';
-
-    // Mark pacman as dead
-    pac->alive = 0;
+    set_cell(board, index, ' ');
+
+    // Mark pacman as dead and end the round when nobody is left. Both the store and the check are
+    // sequentially consistent: of two pacmans killed at once, at least one sees the other dead
+    atomic_store(&pac->alive, 0);
+    if (board->n_delta_hooks > 0) {
+        capture_pacman(pac, -1, &delta.after);
+        emit_delta(board, &delta);
+    }
+    if (first_alive_pacman(board) < 0) {
+        game_end(board, GAME_PACMAN_DEAD);
+    }
+    mark_changed(board);
 }
 
 // Static Loading
@@ -366,82 +866,88 @@ int load_pacman(board_t* board, int points) {
         board->pacmans = calloc(1, sizeof(pacman_t));
     }
     // Coloca 'P' no tabuleiro (assumindo single-thread durante loading)
-    board->board[1 * board->width + 1].content = 'P'; 
+    board->cells[1 * board->width + 1] = 'P'; 
     board->pacmans[0].pos_x = 1;
     board->pacmans[0].pos_y = 1;
-    board->pacmans[0].alive = 1;
+    atomic_store(&board->pacmans[0].alive, 1);
     board->pacmans[0].points = points;
+    board->pacmans[0].player = 0;
+    input_queue_init(&board->pacmans[0].input, board->input_depth);
     return 0;
 }
 
 //Loads a pacman from file
-int load_pacman_file(board_t* board, const char* filepath, int points) {
-    debug("Loading Pacman file: %s\n", filepath);
+int load_pacman_file(board_t* board, const char* filepath, int pacman_index, int points) {
+    log_info(LOG_CAT_LOADER, "Loading Pacman %d from file: %s\n", pacman_index, filepath);
+    pacman_t* pac = &board->pacmans[pacman_index];
+    pac->player = -1;
+    input_queue_init(&pac->input, board->input_depth);
     
     char** tokens = read_file((char*)filepath, board, -1);
+    // PASSO, POS and a lone KEYS line: played from the keyboard, short as it is
+    int keys = tokens && tokens[0] && tokens[1] && tokens[2] && tokens[3] &&
+               strcmp(tokens[3], "KEYS") == 0 && tokens[4] == NULL;
     
-    if (tokens == NULL) {
-        debug("Failed to read pacman file, loading default.\n");
-        load_pacman(board, points);
-        return -1;
-    }
-
-    if (board->cnt_moves < 3) {
-        debug("Not enough tokens in pacman file.\n");
-        for(int i=0; tokens[i] != NULL; i++) free(tokens[i]);
+    if (tokens == NULL || (board->cnt_moves < 3 && !keys)) {
+        log_warn(LOG_CAT_LOADER, tokens ? "Not enough tokens in pacman file.\n" : "Failed to read pacman file.\n");
+        for(int i=0; tokens && tokens[i] != NULL; i++) free(tokens[i]);
         free(tokens);
-        load_pacman(board, points);
+        // The first pacman falls back to the default one, the others stay out of the round
+        if (pacman_index == 0) load_pacman(board, points);
+        else atomic_store(&pac->alive, 0);
         return -1;
     }
 
-    board->pacmans[0].passo = atoi(tokens[0]);
-    board->pacmans[0].pos_y = atoi(tokens[1]); 
-    board->pacmans[0].pos_x = atoi(tokens[2]); 
+    pac->passo = atoi(tokens[0]);
+    pac->pos_y = atoi(tokens[1]); 
+    pac->pos_x = atoi(tokens[2]); 
 
-    board->pacmans[0].alive = 1;
-    board->pacmans[0].points = points;
-    board->pacmans[0].waiting = board->pacmans[0].passo;
-    board->pacmans[0].current_move = 0;
+    atomic_store(&pac->alive, 1);
+    pac->points = points;
+    pac->waiting = pac->passo;
+    pac->current_move = 0;
     
-    int idx = board->pacmans[0].pos_y * board->width + board->pacmans[0].pos_x;
+    int idx = pac->pos_y * board->width + pac->pos_x;
     if(idx >= 0 && idx < board->width * board->height)
-        board->board[idx].content = 'P';
+        board->cells[idx] = 'P';
 
     int move_idx = 0;
     for (int i = 3; tokens[i] != NULL && move_idx < MAX_MOVES; i++) {
         char cmd = tokens[i][0];
-        board->pacmans[0].moves[move_idx].command = cmd;
-        board->pacmans[0].moves[move_idx].turns = 1; 
+        pac->moves[move_idx].command = cmd;
+        pac->moves[move_idx].turns = 1; 
         
         if (cmd == 'T') {
             if (tokens[i+1] != NULL && isdigit(tokens[i+1][0])) {
-                board->pacmans[0].moves[move_idx].turns = atoi(tokens[i+1]);
+                pac->moves[move_idx].turns = atoi(tokens[i+1]);
                 i++; 
             }
         }
-        board->pacmans[0].moves[move_idx].turns_left = board->pacmans[0].moves[move_idx].turns;
+        pac->moves[move_idx].turns_left = pac->moves[move_idx].turns;
         move_idx++;
     }
-    board->pacmans[0].n_moves = move_idx;
-
-    if (board->pacmans[0].n_moves == 0) {
-        board->pacmans[0].moves[0].command = 'T'; // Wait default
-        board->pacmans[0].moves[0].turns = 1;
-        board->pacmans[0].moves[0].turns_left = 1;
-        board->pacmans[0].n_moves = 1;
+    pac->n_moves = move_idx;
+
+    if (keys) {
+        pac->n_moves = 0; // played from the keyboard, load_level_file hands out the keys
+    } else if (pac->n_moves == 0) {
+        pac->moves[0].command = 'T'; // Wait default
+        pac->moves[0].turns = 1;
+        pac->moves[0].turns_left = 1;
+        pac->n_moves = 1;
     }
 
     for(int i=0; tokens[i] != NULL; i++) free(tokens[i]);
     free(tokens);
 
-    debug("Pacman loaded at (%d,%d) with %d moves.\n", board->pacmans[0].pos_x, board->pacmans[0].pos_y, board->pacmans[0].n_moves);
+    log_debug(LOG_CAT_LOADER, "Pacman %d loaded at (%d,%d) with %d moves.\n", pacman_index, pac->pos_x, pac->pos_y, pac->n_moves);
     return 0;
 }
 
 // Static Loading
 int load_ghost(board_t* board) {
     // Ghost 0
-    board->board[3 * board->width + 1].content = 'M';
+    board->cells[3 * board->width + 1] = 'M';
     board->ghosts[0].pos_x = 1;
     board->ghosts[0].pos_y = 3;
     board->ghosts[0].passo = 0;
@@ -458,7 +964,7 @@ int load_ghost(board_t* board) {
     }
 
     // Ghost 1
-    board->board[2 * board->width + 4].content = 'M';
+    board->cells[2 * board->width + 4] = 'M';
     board->ghosts[1].pos_x = 4;
     board->ghosts[1].pos_y = 2;
     board->ghosts[1].passo = 1;
@@ -473,11 +979,11 @@ int load_ghost(board_t* board) {
 
 // Loads a ghost from file
 int load_ghost_file(board_t* board, const char* filepath, int ghost_index) {
-    debug("Loading Ghost %d from file: %s\n", ghost_index, filepath);
+    log_info(LOG_CAT_LOADER, "Loading Ghost %d from file: %s\n", ghost_index, filepath);
     char** tokens = read_file((char*)filepath, board, -1);
     
     if (tokens == NULL) {
-        debug("Failed to read ghost file. Using fallback.\n");
+        log_warn(LOG_CAT_LOADER, "Failed to read ghost file. Using fallback.\n");
         board->ghosts[ghost_index].n_moves = 1;
         board->ghosts[ghost_index].moves[0].command = 'T';
         board->ghosts[ghost_index].moves[0].turns = 1;
@@ -503,7 +1009,7 @@ int load_ghost_file(board_t* board, const char* filepath, int ghost_index) {
     
     int idx = board->ghosts[ghost_index].pos_y * board->width + board->ghosts[ghost_index].pos_x;
     if(idx >= 0 && idx < board->width * board->height)
-        board->board[idx].content = 'M';
+        board->cells[idx] = 'M';
         
     board->ghosts[ghost_index].waiting = board->ghosts[ghost_index].passo;
     board->ghosts[ghost_index].current_move = 0;
@@ -547,11 +1053,7 @@ int load_level(board_t *board, int points) {
     board->n_ghosts = 2;
     board->n_pacmans = 1;
 
-    board->board = calloc(board->width * board->height, sizeof(board_pos_t));
-    
-    for (int i = 0; i < board->width * board->height; i++) {
-        pthread_mutex_init(&board->board[i].mutex, NULL);
-    }
+    alloc_board(board);
 
     board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
     board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
@@ -561,21 +1063,23 @@ int load_level(board_t *board, int points) {
     for (int i = 0; i < board->height; i++) {
         for (int j = 0; j < board->width; j++) {
             if (i == 0 || j == 0 || j == (board->width - 1)) {
-                board->board[i * board->width + j].content = 'W'; 
+                board->cells[i * board->width + j] = 'W'; 
             }
             else if (i == 4 && j == 8) {
-                board->board[i * board->width + j].content = ' ';
-                board->board[i * board->width + j].has_portal = 1;
+                board->cells[i * board->width + j] = ' ';
+                set_bit(board->portals, i * board->width + j);
             }
             else {
-                board->board[i * board->width + j].content = ' ';
-                board->board[i * board->width + j].has_dot = 1;
+                board->cells[i * board->width + j] = ' ';
+                set_bit(board->dots, i * board->width + j);
             }
         }
     }
 
     load_ghost(board);
     load_pacman(board, points);
+    board_seed_agents(board, board->seed);
+    reset_dot_count(board);
 
     return 0;
 }
@@ -583,30 +1087,46 @@ int load_level(board_t *board, int points) {
 // Loads level from a file
 int load_level_file(board_t *board, const char *filepath, int max_files_to_load, int points) {
     (void)max_files_to_load; 
+    uint64_t span = trace_begin();
     
-    debug("Loading level from file: %s\n", filepath);
+    log_info(LOG_CAT_LOADER, "Loading level from file: %s\n", filepath);
     
     board->n_pacmans = 0;
     board->n_ghosts = 0;
-    memset(board->pacman_file, 0, sizeof(board->pacman_file));
+    board->win_on_clear = 0;
+    atomic_store(&board->tick, 0);
+    memset(board->pacman_files, 0, sizeof(board->pacman_files));
     
     read_file((char*)filepath, board, 1); 
+    if (board->cells == NULL) {
+        log_error(LOG_CAT_LOADER, "No board in %s (missing file or DIM line)\n", filepath);
+        trace_end("load_level", span, -1);
+        return -1;
+    }
     
-    debug("Level structure read. Pacman file: %s, Ghosts: %d\n", board->pacman_file, board->n_ghosts);
+    log_debug(LOG_CAT_LOADER, "Level structure read. Pacmans: %d, Ghosts: %d\n", board->n_pacmans, board->n_ghosts);
 
-    if (strlen(board->pacman_file) > 0) {
-        char path_buffer[512];
-        char *dirc = strdup(filepath);
-        char *dname = dirname(dirc);
-        snprintf(path_buffer, sizeof(path_buffer), "%s/%s", dname, board->pacman_file);
-        load_pacman_file(board, path_buffer, points);
-        free(dirc);
+    char *dirc = strdup(filepath);
+    char *dname = dirname(dirc);
+    if (board->n_pacmans > 0) {
+        board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
+        for (int i = 0; i < board->n_pacmans; i++) {
+            char path_buffer[512];
+            snprintf(path_buffer, sizeof(path_buffer), "%s/%s", dname, board->pacman_files[i]);
+            load_pacman_file(board, path_buffer, i, points);
+        }
     } else {
         load_pacman(board, points);
     }
+    // Typed pacmans get the player keys in the order they are listed
+    int players = 0;
+    for (int i = 0; i < board->n_pacmans; i++) {
+        if (board->pacmans[i].n_moves == 0) board->pacmans[i].player = players++;
+    }
+    if (players > MAX_PLAYERS) {
+        log_warn(LOG_CAT_LOADER, "%d pacmans are played from the keyboard, only %d have keys\n", players, MAX_PLAYERS);
+    }
 
-    char *dirc = strdup(filepath);
-    char *dname = dirname(dirc);
     for (int i = 0; i < board->n_ghosts; i++) {
         char path_buffer[512];
         snprintf(path_buffer, sizeof(path_buffer), "%s/%s", dname, board->ghosts_files[i]);
@@ -614,13 +1134,18 @@ int load_level_file(board_t *board, const char *filepath, int max_files_to_load,
     }
     free(dirc);
 
+    board_seed_agents(board, board->seed);
+    reset_dot_count(board);
+    log_info(LOG_CAT_LOADER, "Level has %d dots%s.\n", board->total_dots, board->win_on_clear ? " (clear all dots to win)" : "");
+
     sprintf(board->level_name, "%s", basename((char*)filepath));
+    trace_end("load_level", span, -1);
     return 0;
 }
 
 // Reads a file and parses it into the board structure or tokens
 char** read_file(char* filepath, board_t *board, int max_files_to_load) {
-    debug("Reading file: %s (Mode: %d)\n", filepath, max_files_to_load);
+    log_debug(LOG_CAT_LOADER, "Reading file: %s (Mode: %d)\n", filepath, max_files_to_load);
     
     int fd = open(filepath, O_RDONLY);
     if (fd < 0) {
@@ -735,18 +1260,25 @@ char** read_file(char* filepath, board_t *board, int max_files_to_load) {
 char* parse_line(board_t *board, char *line) {
     if (strncmp(line, "DIM", 3) == 0) {
         sscanf(line + 3, "%d %d", &board->width, &board->height);
-        board->board = calloc(board->width * board->height, sizeof(board_pos_t));
-        
-        for (int i = 0; i < board->width * board->height; i++) {
-            pthread_mutex_init(&board->board[i].mutex, NULL);
-        }
+        alloc_board(board);
 
+    } else if (strncmp(line, "WIN", 3) == 0) {
+        char cond[16] = "";
+        sscanf(line + 3, "%15s", cond);
+        board->win_on_clear = strcmp(cond, "DOTS") == 0;
     } else if (strncmp(line, "TEMPO", 5) == 0) {
         sscanf(line + 5, "%d", &board->tempo);
     } else if (strncmp(line, "PAC", 3) == 0) {
-        sscanf(line + 3, "%s", board->pacman_file);
-        board->n_pacmans = 1;
-        board->pacmans = calloc(1, sizeof(pacman_t));
+        // One file per pacman, on one PAC line or several
+        char *saveptr;
+        char *token = strtok_r(line + 3, " ", &saveptr);
+        while (token != NULL && board->n_pacmans < MAX_PACMANS) {
+            token[strcspn(token, "\r\n")] = 0;
+            if(strlen(token) > 0) {
+                strcpy(board->pacman_files[board->n_pacmans++], token);
+            }
+            token = strtok_r(NULL, " ", &saveptr);
+        }
     } else if (strncmp(line, "MON", 3) == 0) {
         char *saveptr;
         char *token = strtok_r(line + 3, " ", &saveptr);
@@ -761,26 +1293,12 @@ char* parse_line(board_t *board, char *line) {
         board->n_ghosts = idx;
         board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
     } else {
-        if (board->board == NULL) return NULL;
+        if (board->cells == NULL) return NULL;
         line[strcspn(line, "\r\n")] = 0;
         int row = board->current_board_line;
         if (row < board->height) {
-            for (int col = 0; col < board->width && line[col] != '\0'; col++) {
-                int index = row * board->width + col;
-                char c = line[col];
-                
-                if (c == 'X') {
-                    board->board[index].content = 'W';
-                } else if (c == '@') {
-                    board->board[index].content = ' ';
-                    board->board[index].has_portal = 1;
-                } else if (c == 'o') {
-                    board->board[index].content = ' ';
-                    board->board[index].has_dot = 1;
-                } else {
-                    board->board[index].content = ' ';
-                }
-            }
+            int len = strnlen(line, board->width);
+            decode_row(board->cells, board->dots, board->portals, row * board->width, line, len);
             board->current_board_line++;
         }
     }
@@ -788,78 +1306,101 @@ char* parse_line(board_t *board, char *line) {
 }
 
 void unload_level(board_t * board) {
-    if(board->board) {
-        for (int i = 0; i < board->width * board->height; i++) {
-            pthread_mutex_destroy(&board->board[i].mutex);
+    size_t cells = (size_t)board->width * board->height;
+    if(board->locks) {
+        for (size_t i = 0; i < cells; i++) {
+            pthread_mutex_destroy(&board->locks[i]);
         }
-        free(board->board);
+        free_plane(board, board->locks, cells * sizeof(pthread_mutex_t), PLANE_LOCKS);
     }
+    if (board->cells) free_plane(board, board->cells, cells, PLANE_CELLS);
+    if (board->dots) free_plane(board, board->dots, DOT_WORDS(cells) * sizeof(uint64_t), PLANE_DOTS);
+    if (board->portals) free_plane(board, board->portals, DOT_WORDS(cells) * sizeof(uint64_t), PLANE_PORTALS);
+    board->planes_mapped = 0;
+    board->planes_hugetlb = 0;
+    lock_profile_free(board->lock_profile);
     if(board->pacmans) free(board->pacmans);
     if(board->ghosts) free(board->ghosts);
-    board->board = NULL;
+    board->cells = NULL;
+    board->locks = NULL;
+    board->dots = NULL;
+    board->portals = NULL;
+    board->lock_profile = NULL;
     board->pacmans = NULL;
     board->ghosts = NULL;
 }
 
-void open_debug_file(char *filename) {
-    debugfile = fopen(filename, "w");
-}
-
-void close_debug_file() {
-    fclose(debugfile);
+// Character of cell 'index' in a dump: the cell, or '.'/'@' for an empty cell with a dot/portal
+static char dump_cell(board_t* board, int index) {
+    char c = board->cells[index];
+    if (c != ' ') return c;
+    if (board_has_portal(board, index)) return '@';
+    if (board_has_dot(board, index)) return '.';
+    return c;
 }
 
-void debug(const char * format, ...) {
-    va_list args;
-    va_start(args, format);
-    vfprintf(debugfile, format, args);
-    va_end(args);
-
-    fflush(debugfile);
-}
-
-void print_board(board_t *board) {
-    if (!board || !board->board) {
-        debug("[%d] Board is empty or not initialized.\n", getpid());
-        return;
+long dump_board(board_t* board, FILE* out, int mode) {
+    if (!out) return -1;
+    if (!board || !board->cells) {
+        fprintf(out, "[%d] Board is empty or not initialized.\n", getpid());
+        return -1;
     }
 
-    // Large buffer to accumulate the whole output
-    char buffer[8192];
-    size_t offset = 0;
-
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                       "=== [%d] LEVEL INFO ===\n"
-                       "Dimensions: %d x %d\n"
-                       "Tempo: %d\n"
-                       "Pacman file: %s\n",
-                       getpid(), board->height, board->width, board->tempo, board->pacman_file);
-
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                       "Monster files (%d):\n", board->n_ghosts);
-
-    for (int i = 0; i < board->n_ghosts; i++) {
-        offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                           "  - %s\n", board->ghosts_files[i]);
+    long written = fprintf(out, "=== [%d] LEVEL INFO ===\n"
+                 "Dimensions: %d x %d\n"
+                 "Tempo: %d\n"
+                 "Pacman files (%d):\n",
+            getpid(), board->height, board->width, board->tempo, board->n_pacmans);
+    for (int i = 0; i < board->n_pacmans && i < MAX_PACMANS; i++) {
+        written += fprintf(out, "  - %s\n", board->pacman_files[i][0] ? board->pacman_files[i] : "(keyboard)");
+    }
+    written += fprintf(out, "Monster files (%d):\n", board->n_ghosts);
+    for (int i = 0; i < board->n_ghosts && i < MAX_GHOSTS; i++) {
+        written += fprintf(out, "  - %s\n", board->ghosts_files[i]);
     }
+    written += fprintf(out, "\n=== BOARD%s ===\n", mode == DUMP_RLE ? " (RLE)" : "");
 
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n=== BOARD ===\n");
-    
+    // Rows go out through a fixed chunk, so memory does not grow with the board
+    char chunk[DUMP_CHUNK];
+    size_t used = 0;
     for (int y = 0; y < board->height; y++) {
-        for (int x = 0; x < board->width; x++) {
-            int idx = y * board->width + x;
-            if (offset < sizeof(buffer) - 2) {
-                buffer[offset++] = board->board[idx].content;
+        int row = y * board->width;
+        for (int x = 0; x < board->width; ) {
+            char c = dump_cell(board, row + x);
+            int run = 1;
+            if (mode == DUMP_RLE) {
+                while (x + run < board->width && dump_cell(board, row + x + run) == c) run++;
             }
+            if (used + 16 > sizeof(chunk)) {
+                written += fwrite(chunk, 1, used, out);
+                used = 0;
+            }
+            if (run > 1) {
+                char digits[12];
+                int n = 0;
+                for (int r = run; r > 0; r /= 10) digits[n++] = '0' + r % 10;
+                while (n > 0) chunk[used++] = digits[--n];
+            }
+            chunk[used++] = c;
+            x += run;
         }
-        if (offset < sizeof(buffer) - 2) {
-            buffer[offset++] = '\n';
-        }
+        chunk[used++] = '\n';
     }
+    written += fwrite(chunk, 1, used, out);
+    written += fprintf(out, "==================\n");
+    return ferror(out) ? -1 : written;
+}
 
-    offset += snprintf(buffer + offset, sizeof(buffer) - offset, "==================\n");
-
-    buffer[offset] = '\0';
+void print_board(board_t *board, int mode) {
+    if (!board || !board->cells) {
+        log_warn(LOG_CAT_RENDER, "[%d] Board is empty or not initialized.\n", getpid());
+        return;
+    }
+    if (LOG_LEVEL_DEBUG < LOG_LEVEL_MIN || LOG_LEVEL_DEBUG < log_levels[LOG_CAT_RENDER]) return;
 
-    debug("%s", buffer);
-}
\ No newline at end of file
+    FILE* out = debug_stream_begin();
+    if (!out) return;
+    fprintf(out, "render/debug: board dump\n");
+    dump_board(board, out, mode);
+    debug_stream_end(out);
+}
@@ -0,0 +1,295 @@
+#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#define CHECKPOINT_MAGIC "PMCP"
+#define CHECKPOINT_FORMAT 2
+
+// Fixed part of the file, followed by the level path, the board planes, the agents and the journal
+typedef struct {
+    char magic[4];
+    uint32_t format;
+    int32_t width, height;
+    int32_t n_pacmans, n_ghosts;
+    int32_t dots_left;
+    uint32_t tick;
+    uint32_t level_path_len;
+} checkpoint_header_t;
+
+// Journal record: kind, tick and index, then a payload that depends on the kind
+#define RECORD_HEADER (sizeof(uint8_t) + sizeof(uint32_t) + sizeof(int32_t))
+
+static size_t record_payload(uint8_t kind) {
+    switch (kind) {
+        case DELTA_CELL: return sizeof(char);
+        case DELTA_DOT: return 0;
+        case DELTA_PACMAN:
+        case DELTA_GHOST: return sizeof(agent_state_t);
+        default: return (size_t)-1;
+    }
+}
+
+// Helper private function for encoding a delta (only what a redo needs) at 'out'
+static size_t encode_record(char* out, const board_delta_t* delta) {
+    char* p = out;
+    memcpy(p, &delta->kind, sizeof(uint8_t)); p += sizeof(uint8_t);
+    memcpy(p, &delta->tick, sizeof(uint32_t)); p += sizeof(uint32_t);
+    memcpy(p, &delta->index, sizeof(int32_t)); p += sizeof(int32_t);
+
+    if (delta->kind == DELTA_CELL) {
+        *p++ = delta->new_cell;
+    } else if (delta->kind == DELTA_PACMAN || delta->kind == DELTA_GHOST) {
+        memcpy(p, &delta->after, sizeof(agent_state_t));
+        p += sizeof(agent_state_t);
+    }
+    return p - out;
+}
+
+// Helper private function for rewriting the file with a new base snapshot
+static void write_base(checkpoint_t* cp, board_snapshot_t* snap, uint32_t tick, const char* level_path) {
+    if (ftruncate(fileno(cp->file), 0) < 0) {
+        log_error(LOG_CAT_BACKUP, "Checkpoint: failed to truncate file\n");
+    }
+    rewind(cp->file);
+
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+    header.format = CHECKPOINT_FORMAT;
+    header.width = snap->width;
+    header.height = snap->height;
+    header.n_pacmans = snap->n_pacmans;
+    header.n_ghosts = snap->n_ghosts;
+    header.dots_left = snap->dots_left;
+    header.tick = tick;
+    header.level_path_len = strlen(level_path);
+
+    size_t cells = (size_t)snap->width * snap->height;
+    fwrite(&header, sizeof(header), 1, cp->file);
+    fwrite(level_path, 1, header.level_path_len, cp->file);
+    fwrite(snap->cells, 1, cells, cp->file);
+    fwrite(snap->dots, sizeof(uint64_t), (cells + 63) / 64, cp->file);
+    fwrite(snap->pacmans, sizeof(pacman_t), snap->n_pacmans, cp->file);
+    fwrite(snap->ghosts, sizeof(ghost_t), snap->n_ghosts, cp->file);
+    cp->records = 0;
+}
+
+// Writer thread: waits for a base or enough journal, then writes it without holding the lock
+static void* writer_task(void* arg) {
+    checkpoint_t* cp = (checkpoint_t*)arg;
+    char level_path[sizeof(cp->level_path)];
+
+    pthread_mutex_lock(&cp->mutex);
+    while (true) {
+        while (!cp->stop && !cp->base_pending && cp->pending_len < CHECKPOINT_FLUSH_BYTES) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += CHECKPOINT_FLUSH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            if (pthread_cond_timedwait(&cp->cond, &cp->mutex, &deadline) == ETIMEDOUT) break;
+        }
+
+        int has_base = cp->base_pending;
+        uint32_t base_tick = cp->base_tick;
+        if (has_base) {
+            board_snapshot_t tmp = cp->writing;
+            cp->writing = cp->base;
+            cp->base = tmp;
+            cp->base_pending = 0;
+            memcpy(level_path, cp->level_path, sizeof(level_path));
+        }
+
+        // Take the pending journal and give the agents the spare buffer
+        char* data = cp->pending;
+        size_t len = cp->pending_len;
+        size_t cap = cp->pending_cap;
+        cp->pending = cp->spare;
+        cp->pending_cap = cp->spare_cap;
+        cp->pending_len = 0;
+        cp->spare = data;
+        cp->spare_cap = cap;
+        int stop = cp->stop;
+        pthread_mutex_unlock(&cp->mutex);
+
+        if (has_base) {
+            write_base(cp, &cp->writing, base_tick, level_path);
+        }
+        if (len > 0) {
+            fwrite(data, 1, len, cp->file);
+        }
+        fflush(cp->file);
+
+        pthread_mutex_lock(&cp->mutex);
+        if (stop && !cp->base_pending && cp->pending_len == 0) break;
+    }
+    pthread_mutex_unlock(&cp->mutex);
+    return NULL;
+}
+
+int checkpoint_open(checkpoint_t* cp, const char* path) {
+    memset(cp, 0, sizeof(checkpoint_t));
+    cp->file = fopen(path, "wb");
+    if (!cp->file) {
+        perror("Failed to open checkpoint file");
+        return -1;
+    }
+    pthread_mutex_init(&cp->mutex, NULL);
+    pthread_cond_init(&cp->cond, NULL);
+    if (pthread_create(&cp->writer, NULL, writer_task, cp) != 0) {
+        fclose(cp->file);
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_base(checkpoint_t* cp, board_t* board, const char* level_path) {
+    pthread_mutex_lock(&cp->mutex);
+    int result = snapshot_save(&cp->base, board);
+    if (result == 0) {
+        cp->base_tick = atomic_load(&board->tick);
+        snprintf(cp->level_path, sizeof(cp->level_path), "%s", level_path);
+        cp->pending_len = 0; // deltas before the base are already in it
+        cp->base_pending = 1;
+        pthread_cond_signal(&cp->cond);
+    }
+    pthread_mutex_unlock(&cp->mutex);
+    return result;
+}
+
+void checkpoint_hook(void* ctx, const board_delta_t* delta) {
+    checkpoint_t* cp = (checkpoint_t*)ctx;
+    size_t needed = RECORD_HEADER + sizeof(agent_state_t);
+
+    pthread_mutex_lock(&cp->mutex);
+    if (cp->pending_len + needed > cp->pending_cap) {
+        size_t new_cap = cp->pending_cap ? cp->pending_cap * 2 : CHECKPOINT_FLUSH_BYTES * 2;
+        char* new_pending = realloc(cp->pending, new_cap);
+        if (!new_pending) {
+            pthread_mutex_unlock(&cp->mutex);
+            return;
+        }
+        cp->pending = new_pending;
+        cp->pending_cap = new_cap;
+    }
+    cp->pending_len += encode_record(cp->pending + cp->pending_len, delta);
+    cp->records++;
+    int wake = cp->pending_len >= CHECKPOINT_FLUSH_BYTES;
+    pthread_mutex_unlock(&cp->mutex);
+
+    if (wake) {
+        pthread_cond_signal(&cp->cond);
+    }
+}
+
+void checkpoint_close(checkpoint_t* cp) {
+    if (!cp->file) return;
+
+    pthread_mutex_lock(&cp->mutex);
+    cp->stop = 1;
+    pthread_cond_signal(&cp->cond);
+    pthread_mutex_unlock(&cp->mutex);
+    pthread_join(cp->writer, NULL);
+
+    fclose(cp->file);
+    pthread_mutex_destroy(&cp->mutex);
+    pthread_cond_destroy(&cp->cond);
+    snapshot_free(&cp->base);
+    snapshot_free(&cp->writing);
+    free(cp->pending);
+    free(cp->spare);
+    memset(cp, 0, sizeof(checkpoint_t));
+}
+
+// Helper private function for reading and checking the header of a checkpoint file
+static int read_header(FILE* f, checkpoint_header_t* header) {
+    if (fread(header, sizeof(*header), 1, f) != 1 ||
+        memcmp(header->magic, CHECKPOINT_MAGIC, 4) != 0 || header->format != CHECKPOINT_FORMAT) {
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_level(const char* path, char* level_path, size_t len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+
+    checkpoint_header_t header;
+    int result = -1;
+    if (read_header(f, &header) == 0 && header.level_path_len < len &&
+        fread(level_path, 1, header.level_path_len, f) == header.level_path_len) {
+        level_path[header.level_path_len] = '\0';
+        result = 0;
+    }
+    fclose(f);
+    return result;
+}
+
+long checkpoint_load(const char* path, board_t* board) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror("Failed to open checkpoint file");
+        return -1;
+    }
+
+    checkpoint_header_t header;
+    if (read_header(f, &header) < 0 || header.width != board->width || header.height != board->height ||
+        header.n_pacmans != board->n_pacmans || header.n_ghosts != board->n_ghosts) {
+        log_warn(LOG_CAT_BACKUP, "Checkpoint %s does not match the loaded level\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    // Base snapshot
+    size_t cells = (size_t)header.width * header.height;
+    size_t words = (cells + 63) / 64;
+    fseek(f, header.level_path_len, SEEK_CUR);
+    if (fread(board->cells, 1, cells, f) != cells ||
+        fread(board->dots, sizeof(uint64_t), words, f) != words ||
+        fread(board->pacmans, sizeof(pacman_t), header.n_pacmans, f) != (size_t)header.n_pacmans ||
+        fread(board->ghosts, sizeof(ghost_t), header.n_ghosts, f) != (size_t)header.n_ghosts) {
+        log_warn(LOG_CAT_BACKUP, "Checkpoint %s is truncated\n", path);
+        fclose(f);
+        return -1;
+    }
+    atomic_store(&board->dots_left, header.dots_left);
+    atomic_store(&board->tick, header.tick);
+    for (int i = 0; i < board->n_pacmans; i++) {
+        input_queue_init(&board->pacmans[i].input, board->input_depth);
+    }
+
+    // Journal; a record cut short by a crash ends the replay
+    long replayed = 0;
+    char record[RECORD_HEADER + sizeof(agent_state_t)];
+    while (fread(record, RECORD_HEADER, 1, f) == 1) {
+        board_delta_t delta;
+        memset(&delta, 0, sizeof(delta));
+        memcpy(&delta.kind, record, sizeof(uint8_t));
+        memcpy(&delta.tick, record + sizeof(uint8_t), sizeof(uint32_t));
+        memcpy(&delta.index, record + sizeof(uint8_t) + sizeof(uint32_t), sizeof(int32_t));
+
+        size_t payload = record_payload(delta.kind);
+        if (payload == (size_t)-1 || (payload > 0 && fread(record + RECORD_HEADER, payload, 1, f) != 1)) break;
+
+        if (delta.kind == DELTA_CELL) {
+            delta.new_cell = record[RECORD_HEADER];
+        } else if (delta.kind == DELTA_PACMAN || delta.kind == DELTA_GHOST) {
+            memcpy(&delta.after, record + RECORD_HEADER, sizeof(agent_state_t));
+        }
+        if (delta.index < 0 ||
+            (delta.kind == DELTA_PACMAN && delta.index >= board->n_pacmans) ||
+            (delta.kind == DELTA_GHOST && delta.index >= board->n_ghosts) ||
+            ((delta.kind == DELTA_CELL || delta.kind == DELTA_DOT) && (size_t)delta.index >= cells)) break;
+
+        apply_delta(board, &delta, 0);
+        atomic_store(&board->tick, delta.tick);
+        replayed++;
+    }
+
+    fclose(f);
+    return replayed;
+}
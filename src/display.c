@@ -1,7 +1,15 @@
 #include "display.h"
 #include "board.h"
+#include "metrics.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Self-pipe used by terminal_wakeup to interrupt the poll in wait_input
+static int wakeup_pipe[2] = {-1, -1};
 
 
 int terminal_init() {
@@ -40,10 +48,27 @@ int terminal_init() {
     // Clear the screen
     clear();
 
+    if (pipe(wakeup_pipe) < 0) {
+        return -1;
+    }
+    fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+
     return 0;
 }
 
 
+// Keys of the pacmans played from the keyboard, "W/A/S/D, I/J/K/L" with two players
+static void keys_hint(board_t* board, char* buf, size_t len) {
+    size_t used = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < board->n_pacmans && used < len; i++) {
+        const char* keys = board->pacmans[i].n_moves == 0 ? player_keys_of(board->pacmans[i].player) : NULL;
+        if (!keys) continue;
+        used += snprintf(buf + used, len - used, "%s%c/%c/%c/%c", used ? ", " : "", keys[0], keys[1], keys[2], keys[3]);
+    }
+}
+
 void draw_board(board_t* board, int mode) {
     // Clear the screen before redrawing
     clear();
@@ -51,7 +76,7 @@ void draw_board(board_t* board, int mode) {
     // Draw the border/title
     attron(COLOR_PAIR(5));
     mvprintw(0, 0, "=== PACMAN GAME ===");
-    switch(mode) {
+    switch(mode & ~DRAW_METRICS) {
     case DRAW_GAME_OVER:
         mvprintw(1, 0, " GAME OVER ");
         break;
@@ -60,8 +85,18 @@ void draw_board(board_t* board, int mode) {
         mvprintw(1, 0, " VICTORY ");
         break;
 
-    case DRAW_MENU:
-        mvprintw(1, 0, "Level: %s | Use W/A/S/D to move | Q to quit | G to quicksave ", board->level_name);
+    case DRAW_MENU: {
+        char keys[64];
+        keys_hint(board, keys, sizeof(keys));
+        if (keys[0] != '\0')
+            mvprintw(1, 0, "Level: %s | Use %s to move | Q to quit | G to quicksave | U to rewind | M for stats ", board->level_name, keys);
+        else
+            mvprintw(1, 0, "Level: %s | Q to quit | G to quicksave | U to rewind | M for stats ", board->level_name);
+        break;
+    }
+
+    case DRAW_SPECTATE:
+        mvprintw(1, 0, "Level: %s | Spectating, tick %u | Q to quit ", board->level_name, atomic_load(&board->tick));
         break;
     }
 
@@ -73,7 +108,7 @@ void draw_board(board_t* board, int mode) {
     for (int y = 0; y < board->height; y++) {
         for (int x = 0; x < board->width; x++) {
             int index = y * board->width + x;
-            char ch = board->board[index].content;
+            char ch = board->cells[index];
             int ghost_charged = 0;
 
             for (int g = 0; g < board->n_ghosts; g++) {
@@ -109,12 +144,12 @@ void draw_board(board_t* board, int mode) {
                     break;
 
                 case ' ': // Empty space
-                    if (board->board[index].has_portal) {
+                    if (board_has_portal(board, index)) {
                         attron(COLOR_PAIR(6));
                         addch('@');
                         attroff(COLOR_PAIR(6));
                     }
-                    else if (board->board[index].has_dot) {
+                    else if (board_has_dot(board, index)) {
                         attron(COLOR_PAIR(4));
                         addch('.');
                         attroff(COLOR_PAIR(4));
@@ -132,8 +167,18 @@ void draw_board(board_t* board, int mode) {
 
     // Draw score/status at the bottom
     attron(COLOR_PAIR(5));
-    mvprintw(start_row + board->height + 1, 0, "Points: %d",
-             board->pacmans[0].points); // Assuming first pacman for now
+    // One score per pacman, a dead one marked with 'x'
+    move(start_row + board->height + 1, 0);
+    printw("Points:");
+    for (int i = 0; i < board->n_pacmans; i++) {
+        printw(" %d%s", board->pacmans[i].points, atomic_load(&board->pacmans[i].alive) ? "" : "x");
+    }
+    printw(" | Dots: %d/%d", atomic_load(&board->dots_left), board->total_dots);
+    if (mode & DRAW_METRICS) {
+        char stats[160];
+        metrics_summary(stats, sizeof(stats));
+        mvprintw(start_row + board->height + 2, 0, "%s", stats);
+    }
     attroff(COLOR_PAIR(5));
 }
 
@@ -165,8 +210,18 @@ char get_input() {
         case 'S':
         case 'A':
         case 'D':
+        case 'I':
+        case 'J':
+        case 'K':
+        case 'L':
+        case '8':
+        case '4':
+        case '5':
+        case '6':
         case 'Q':
         case 'G':
+        case 'U':
+        case 'M':
 
             return (char)ch;
         
@@ -175,7 +230,44 @@ char get_input() {
     }
 }
 
+char wait_input(int timeout_ms) {
+    // ncurses may already hold keys it read from stdin in an earlier call
+    char key = get_input();
+    if (key != '\0') {
+        return key;
+    }
+
+    struct pollfd fds[2] = {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = wakeup_pipe[0], .events = POLLIN },
+    };
+    if (poll(fds, 2, timeout_ms) <= 0) {
+        return '\0';
+    }
+
+    if (fds[1].revents & POLLIN) {
+        char drain[64];
+        while (read(wakeup_pipe[0], drain, sizeof(drain)) > 0);
+    }
+    if (fds[0].revents & POLLIN) {
+        return get_input();
+    }
+    return '\0';
+}
+
+void terminal_wakeup() {
+    // A full pipe already guarantees a pending wakeup, so a failed write is fine
+    char c = 0;
+    if (write(wakeup_pipe[1], &c, 1) < 0) {
+        return;
+    }
+}
+
 void terminal_cleanup() {
     // Restore terminal settings and clean up ncurses
     endwin();
+
+    close(wakeup_pipe[0]);
+    close(wakeup_pipe[1]);
+    wakeup_pipe[0] = wakeup_pipe[1] = -1;
 }
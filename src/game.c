@@ -1,5 +1,14 @@
 #include "board.h"
 #include "display.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "rewind.h"
+#include "metrics.h"
+#include "lock_profile.h"
+#include "trace.h"
+#include "replay.h"
+#include "affinity.h"
+#include "spectate.h"
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
@@ -8,55 +17,122 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <sys/types.h>
-#include <sys/wait.h>
 #include <pthread.h>
 
 #define CONTINUE_PLAY 0
 #define NEXT_LEVEL 1
 #define QUIT_GAME 2
 #define DO_BACKUP 3
-#define EXIT_PACMAN_DIED 5
+#define DO_REWIND 4
+#define IDLE_WAKEUP_MS 1000 // safety net: the main loop re-checks the game state at least this often
 
 // Estrutura para passar argumentos às threads
 typedef struct {
     board_t *board;
     int id;
+    recorder_t *recorder;   // engine only: where the typed commands are recorded
+    spectate_feed_t *feed;  // pacman/engine only: where each tick is published for spectators, or NULL
+    atomic_int *end_request; // engine only: game_state_t the player asked for, GAME_RUNNING for none
 } thread_arg_t;
 
+// Acorda o ciclo principal se o tabuleiro mudou desde 'seen' ou o jogo terminou
+static void notify_main_loop(board_t *board, unsigned seen) {
+    if (atomic_load(&board->version) != seen || !game_is_running(board)) {
+        terminal_wakeup();
+    }
+}
+
+// Conta um tick nas métricas, com o trabalho feito desde 'tick_start' (0 sem métricas)
+static void count_tick(board_t *board, uint64_t tick_start) {
+    if (!tick_start) return;
+    uint64_t work = now_ns() - tick_start;
+    metric_record(METRIC_HIST_TICK_NS, work);
+    metric_count(METRIC_TICKS, 1);
+    if (board->tempo > 0 && work > (uint64_t)board->tempo * 1000000) metric_count(METRIC_TICK_OVERRUNS, 1);
+}
+
 // Tarefa da Thread do Pacman
 void* pacman_task(void* arg) {
     thread_arg_t *data = (thread_arg_t *)arg;
     board_t *board = data->board;
     int index = data->id;
     pacman_t * pac = &board->pacmans[index];
+    if (trace_on()) {
+        char name[32];
+        snprintf(name, sizeof(name), "pacman %d", index);
+        trace_thread_name(name);
+    }
+    affinity_pin_role(board, AFFINITY_PACMAN, index);
 
-    while (board->game_running && pac->alive) {
+    while (game_is_running(board) && atomic_load_explicit(&pac->alive, memory_order_acquire)) {
+        uint64_t tick_start = metrics_on() ? now_ns() : 0;
         command_t *cmd_ptr = NULL;
         command_t cmd_manual;
+        input_cmd_t input;
+        int has_input = 0;
 
         if (pac->n_moves > 0) {
             cmd_ptr = &pac->moves[pac->current_move % pac->n_moves];
         } else {
             cmd_manual.turns = 1;
             cmd_manual.turns_left = 0;
-            char dir = pac->next_direction;
-            if (dir != '\0') {
-                cmd_manual.command = dir;
-                pac->next_direction = '\0'; // Consome o comando
-            } else {
-                cmd_manual.command = '\0';
-            }
+            // Consome o comando mais antigo da fila
+            has_input = input_queue_pop(&pac->input, &input);
+            cmd_manual.command = has_input ? input.command : '\0';
             cmd_ptr = &cmd_manual;
         }
 
         if (cmd_ptr->command != '\0') {
+            unsigned seen = atomic_load(&board->version);
             int result = move_pacman(board, index, cmd_ptr);
+            if (has_input) {
+                input_queue_record_latency(&pac->input, &input);
+            }
             if (result == REACHED_PORTAL) {
-                board->game_running = 0;
+                game_end(board, GAME_PORTAL_REACHED);
             } 
+            notify_main_loop(board, seen);
         }
 
+        // O passo do primeiro pacman vivo marca o ritmo do jogo
+        if (first_alive_pacman(board) == index) {
+            atomic_fetch_add(&board->tick, 1);
+            if (data->feed) spectate_publish(data->feed, board);
+        }
+        count_tick(board, tick_start);
+        sleep_ms(board->tempo);
+    }
+    free(data);
+    return NULL;
+}
+
+// Tarefa da thread única que move todos os agentes quando a sessão é gravada: cada tick é o
+// mesmo board_tick_keys que a reprodução corre, com as teclas tiradas das filas, por isso a
+// gravação reproduz-se sem divergências. Os fins de ronda pedidos pelo jogador só se aplicam
+// entre ticks, porque a reprodução corre sempre ticks inteiros
+void* engine_task(void* arg) {
+    thread_arg_t *data = (thread_arg_t *)arg;
+    board_t *board = data->board;
+    if (trace_on()) trace_thread_name("engine");
+    affinity_pin_role(board, AFFINITY_PACMAN, 0);
+
+    while (game_is_running(board)) {
+        game_state_t request = atomic_exchange(data->end_request, GAME_RUNNING);
+        if (request != GAME_RUNNING) {
+            game_end(board, request);
+            terminal_wakeup();
+            break;
+        }
+        uint64_t tick_start = metrics_on() ? now_ns() : 0;
+        input_cmd_t inputs[MAX_PACMANS];
+        unsigned seen = atomic_load(&board->version);
+        unsigned popped = recorder_tick(data->recorder, board, inputs);
+        for (int i = 0; i < board->n_pacmans && i < MAX_PACMANS; i++) {
+            if (popped & (1u << i)) input_queue_record_latency(&board->pacmans[i].input, &inputs[i]);
+        }
+        if (data->feed) spectate_publish(data->feed, board);
+        notify_main_loop(board, seen);
+        count_tick(board, tick_start);
         sleep_ms(board->tempo);
     }
     free(data);
@@ -69,45 +145,210 @@ void* ghost_task(void* arg) {
     board_t *board = data->board;
     int index = data->id;
     ghost_t * ghost = &board->ghosts[index];
+    if (trace_on()) {
+        char name[32];
+        snprintf(name, sizeof(name), "ghost %d", index);
+        trace_thread_name(name);
+    }
+    affinity_pin_role(board, AFFINITY_GHOST, index);
 
-    while (board->game_running) {
+    while (game_is_running(board)) {
         // Fantasmas movem-se autonomamente
         command_t *cmd = &ghost->moves[ghost->current_move % ghost->n_moves];
+        unsigned seen = atomic_load(&board->version);
         move_ghost(board, index, cmd);
+        notify_main_loop(board, seen);
         sleep_ms(board->tempo);
     }
     free(data);
     return NULL;
 } 
 
+// Acaba a ronda a pedido do jogador; numa sessão gravada ('end_request') fica para a thread do
+// motor, que a acaba entre dois ticks
+static void request_end(board_t *board, atomic_int *end_request, game_state_t reason) {
+    if (end_request) atomic_store(end_request, reason);
+    else game_end(board, reason);
+}
+
+// Traduz o motivo de fim de ronda no resultado usado pelo ciclo dos níveis
+static int exit_reason_for(game_state_t state) {
+    switch (state) {
+        case GAME_PORTAL_REACHED:
+            return NEXT_LEVEL;
+        case GAME_BACKUP_REQUESTED:
+            return DO_BACKUP;
+        case GAME_REWIND_REQUESTED:
+            return DO_REWIND;
+        case GAME_PACMAN_DEAD:
+        case GAME_QUIT:
+        default:
+            return QUIT_GAME;
+    }
+}
+
 // Função para atualizar o ecrã
 void screen_refresh(board_t * game_board, int mode) {
+    uint64_t span = trace_begin();
     draw_board(game_board, mode);
     refresh_screen();
+    trace_end("draw", span, -1);
     if(game_board->tempo != 0)
         sleep_ms(game_board->tempo);       
 }
 
+// Imprime as opções da linha de comandos
+static void usage(const char *prog) {
+    printf("Usage: %s [-q input_depth] [-c checkpoint] [-r checkpoint] [-w rewind_kb] [-l log_levels] [-m stats_file] [-p lock_heatmap] [-t trace_file] [-i record_file] [-a placement] [-H pages] [-s feed] <levels_directory>\n", prog);
+    printf("  -q input_depth  keypresses buffered for the pacman (1-%d, default %d)\n",
+           MAX_INPUT_DEPTH, DEFAULT_INPUT_DEPTH);
+    printf("  -c checkpoint   keep a checkpoint of the game in this file\n");
+    printf("  -r checkpoint   resume the game from this checkpoint file\n");
+    printf("  -w rewind_kb    keep this much recent history to rewind with U or after dying (default %d when 0)\n",
+           DEFAULT_REWIND_KB);
+    printf("  -l log_levels   what goes to debug.log: a level (trace, debug, info, warn, error, off)\n"
+           "                  for everything and/or category=level, e.g. info,movement=trace\n"
+           "                  (categories: loader, movement, render, backup; default debug)\n");
+    printf("  -m stats_file   append engine metrics to this file every second (JSON lines)\n");
+    printf("  -p lock_heatmap time every cell lock and write a contention heatmap per level to this file\n");
+    printf("  -t trace_file   record a timeline of the threads and save it as Chrome trace JSON at exit\n");
+    printf("  -i record_file  record the typed commands of the session for bin/bench replay; the agents\n"
+           "                  then move on one engine thread, in the order the replay uses\n");
+    printf("  -a placement    pin the render, logger, pacman and ghost threads: compact, spread\n"
+           "                  or a CPU list such as 0,2,4-7 (default none)\n");
+    printf("  -s feed         publish every tick to the shared memory feed /feed for bin/spectator\n");
+    printf("  -H pages        back large boards with huge pages: off, thp or hugetlb (falls back to thp)\n");
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Usage: %s <levels_directory>\n", argv[0]);
+    int input_depth = DEFAULT_INPUT_DEPTH;
+    const char *checkpoint_path = NULL;
+    const char *resume_path = NULL;
+    long rewind_kb = -1;
+    const char *stats_path = NULL;
+    const char *heatmap_path = NULL;
+    const char *record_path = NULL;
+    int huge_pages = HUGE_PAGES_OFF;
+    const char *feed_name = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "q:c:r:w:l:m:p:t:i:a:H:s:")) != -1) {
+        switch (opt) {
+            case 'q':
+                input_depth = atoi(optarg);
+                if (input_depth < 1 || input_depth > MAX_INPUT_DEPTH) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                checkpoint_path = optarg;
+                break;
+            case 'r':
+                resume_path = optarg;
+                break;
+            case 'w':
+                rewind_kb = atol(optarg);
+                if (rewind_kb < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if (log_configure(optarg) < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                stats_path = optarg;
+                break;
+            case 'p':
+                heatmap_path = optarg;
+                break;
+            case 't':
+                trace_start(optarg);
+                trace_thread_name("main");
+                break;
+            case 'i':
+                record_path = optarg;
+                break;
+            case 'a':
+                if (affinity_configure(optarg) < 0) {
+                    fprintf(stderr, "Bad placement %s (CPUs must be ones the process may use)\n", optarg);
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                feed_name = optarg;
+                break;
+            case 'H':
+                huge_pages = parse_huge_pages(optarg);
+                if (huge_pages < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
-    srand((unsigned int)time(NULL));
+    uint64_t seed = (uint64_t)time(NULL);
     board_t game_board;
 
     memset(&game_board, 0, sizeof(board_t));
+    game_board.seed = seed;
+    game_board.input_depth = input_depth;
+    game_board.huge_pages = huge_pages;
+
+    FILE *heatmap = NULL;
+    if (heatmap_path != NULL) {
+        heatmap = fopen(heatmap_path, "w");
+        if (!heatmap) {
+            perror("Failed to create lock heatmap file");
+            return EXIT_FAILURE;
+        }
+        game_board.profile_locks = 1;
+    }
+    recorder_t recorder;
+    bool recording = false;
+    if (record_path != NULL) {
+        if (recorder_open(&recorder, record_path, seed, rewind_kb) < 0) {
+            perror("Failed to create record file");
+            return EXIT_FAILURE;
+        }
+        recording = true;
+    }
+    spectate_feed_t feed;
+    bool spectating = false;
+    if (feed_name != NULL) {
+        if (spectate_open(&feed, feed_name) < 0) {
+            perror("Failed to create spectator feed");
+            return EXIT_FAILURE;
+        }
+        spectating = true;
+    }
     open_debug_file("debug.log");
+    if (stats_path != NULL && metrics_start(stats_path) < 0) {
+        fprintf(stderr, "Failed to create stats file %s\n", stats_path);
+        return EXIT_FAILURE;
+    }
     terminal_init();
     
-    int accumulated_points = 0;
+    int accumulated_points[MAX_PACMANS] = { 0 }; // cada pacman leva os seus pontos para o nível seguinte
+    int overlay = 0;    // DRAW_METRICS while the metrics overlay is on
     bool end_game = false;
     char **lvl_paths = NULL;
     int index_lp = 0;
     int cnt_lvl = 0;
 
-    const char *dirpath = argv[1];
-    debug("Loading levels from directory: %s\n", dirpath);
+    const char *dirpath = argv[optind];
+    log_info(LOG_CAT_LOADER, "Loading levels from directory: %s\n", dirpath);
     
     DIR *dirp = opendir(dirpath);
     if (dirp != NULL) {
@@ -121,6 +362,7 @@ int main(int argc, char** argv) {
 
         if (cnt_lvl == 0) {
             terminal_cleanup();
+            if (spectating) spectate_close(&feed);
             fprintf(stderr, "No .lvl files found in the directory.\n");
             return EXIT_FAILURE;
         }
@@ -141,162 +383,287 @@ int main(int argc, char** argv) {
     }
 
     index_lp = 0;
-    bool has_backup = false;
+
+    // Retoma no nível onde o checkpoint foi tirado
+    char resume_level[2 * MAX_FILENAME] = "";
+    if (resume_path != NULL) {
+        if (checkpoint_level(resume_path, resume_level, sizeof(resume_level)) < 0) {
+            log_warn(LOG_CAT_BACKUP, "%s is not a checkpoint file, starting from the first level\n", resume_path);
+            resume_level[0] = '\0';
+        }
+        for (int i = 0; i < cnt_lvl && resume_level[0] != '\0'; i++) {
+            if (strcmp(lvl_paths[i], resume_level) == 0) index_lp = i;
+        }
+    }
+
+    checkpoint_t checkpoint;
+    bool checkpointing = false;
+    if (checkpoint_path != NULL && checkpoint_open(&checkpoint, checkpoint_path) == 0) {
+        add_delta_hook(&game_board, checkpoint_hook, &checkpoint);
+        checkpointing = true;
+    }
+
+    rewind_buffer_t rewind;
+    bool rewinding = false;
+    if (rewind_kb >= 0 && rewind_init(&rewind, rewind_kb) == 0) {
+        add_delta_hook(&game_board, rewind_hook, &rewind);
+        rewinding = true;
+    }
+
+    // Quicksaves do nível atual, usados como pilha: G guarda, a morte do pacman restaura o mais recente
+    board_snapshot_t saves[MAX_SNAPSHOTS];
+    memset(saves, 0, sizeof(saves));
+
+    // O ciclo principal só se fixa depois de lançar as threads auxiliares, que herdariam o seu CPU
+    if (affinity_policy() != AFFINITY_NONE) {
+        char cpus[256];
+        affinity_describe(cpus, sizeof(cpus));
+        log_info(LOG_CAT_LOADER, "Thread placement %s over CPUs %s\n", affinity_policy_name(affinity_policy()), cpus);
+        affinity_pin(affinity_slot(AFFINITY_RENDER, 0, 0));
+    }
 
     while (!end_game) {
         if (index_lp >= cnt_lvl) {
             end_game = true;
             break;
         }
-        load_level_file(&game_board, lvl_paths[index_lp++], 0, accumulated_points);
+        const char *level_path = lvl_paths[index_lp++];
+        load_level_file(&game_board, level_path, 0, 0);
+        for (int i = 0; i < game_board.n_pacmans; i++) {
+            game_board.pacmans[i].points = accumulated_points[i];
+        }
+
+        if (resume_level[0] != '\0' && strcmp(level_path, resume_level) == 0) {
+            uint64_t start = now_ns();
+            long replayed = checkpoint_load(resume_path, &game_board);
+            log_info(LOG_CAT_BACKUP, "Resumed from %s: %ld journal records replayed in %.3f ms\n",
+                  resume_path, replayed, (now_ns() - start) / 1e6);
+            resume_level[0] = '\0';
+        }
+        if (checkpointing) {
+            checkpoint_base(&checkpoint, &game_board, level_path);
+        }
+        if (rewinding) {
+            rewind_clear(&rewind, &game_board);
+        }
+        if (recording) {
+            recorder_level(&recorder, level_path);
+        }
 
 
         int level_result = CONTINUE_PLAY;
+        game_state_t end_state = GAME_RUNNING;
+        int n_saves = 0;
 
         while (true) {
-            game_board.game_running = 1;
+            game_start(&game_board);
             
-            pthread_t pacman_tid;
+            pthread_t engine_tid;
+            pthread_t pacman_tids[MAX_PACMANS];
             pthread_t ghost_tids[MAX_GHOSTS];
+            // Uma sessão gravada corre numa só thread, no tick determinístico da reprodução
+            int agent_threads = !recording;
 
-            if (game_board.n_pacmans > 0) {
+            atomic_int end_request = GAME_RUNNING;
+            atomic_int *engine_request = recording ? &end_request : NULL;
+
+            if (recording) {
                 thread_arg_t *arg = malloc(sizeof(thread_arg_t));
                 arg->board = &game_board;
                 arg->id = 0;
-                pthread_create(&pacman_tid, NULL, pacman_task, arg);
+                arg->recorder = &recorder;
+                arg->feed = spectating ? &feed : NULL;
+                arg->end_request = &end_request;
+                pthread_create(&engine_tid, NULL, engine_task, arg);
             }
 
-            for (int i = 0; i < game_board.n_ghosts; i++) {
+            for (int i = 0; agent_threads && i < game_board.n_pacmans; i++) {
                 thread_arg_t *arg = malloc(sizeof(thread_arg_t));
                 arg->board = &game_board;
                 arg->id = i;
+                arg->recorder = NULL;
+                arg->feed = spectating ? &feed : NULL;
+                arg->end_request = NULL;
+                pthread_create(&pacman_tids[i], NULL, pacman_task, arg);
+            }
+
+            for (int i = 0; agent_threads && i < game_board.n_ghosts; i++) {
+                thread_arg_t *arg = malloc(sizeof(thread_arg_t));
+                arg->board = &game_board;
+                arg->id = i;
+                arg->recorder = NULL;
+                arg->feed = NULL;
+                arg->end_request = NULL;
                 pthread_create(&ghost_tids[i], NULL, ghost_task, arg);
             }
 
-            int exit_reason = CONTINUE_PLAY;
-            
-            while (game_board.game_running) {
-                draw_board(&game_board, DRAW_MENU);
-                refresh_screen();
+            unsigned drawn_version = atomic_load(&game_board.version) - 1;
+
+            while (game_is_running(&game_board)) {
+                // Só redesenha quando algum agente mudou o tabuleiro
+                unsigned version = atomic_load(&game_board.version);
+                // Com as métricas visíveis redesenha também a cada despertar, para atualizar as taxas
+                if (version != drawn_version || overlay) {
+                    uint64_t span = trace_begin();
+                    draw_board(&game_board, DRAW_MENU | overlay);
+                    refresh_screen();
+                    trace_end("draw", span, -1);
+                    log_trace(LOG_CAT_RENDER, "REFRESH version %u\n", version);
+                    drawn_version = version;
+                }
+
+                // Bloqueia até chegar uma tecla ou um agente acordar o ciclo
+                uint64_t idle = trace_begin();
+                char input = wait_input(IDLE_WAKEUP_MS);
+                trace_end("wait_input", idle, -1);
+                if (input != '\0') log_trace(LOG_CAT_MOVEMENT, "KEY %c\n", input);
 
-                char input = get_input();
-                
                 if (input == 'Q') {
-                    game_board.game_running = 0;
-                    exit_reason = QUIT_GAME;
+                    request_end(&game_board, engine_request, GAME_QUIT);
                 } 
                 else if (input == 'G') {
-                    if (!has_backup) {
-                        game_board.game_running = 0;
-                        exit_reason = DO_BACKUP;
-                    }
+                    request_end(&game_board, engine_request, GAME_BACKUP_REQUESTED);
                 } 
-                else if (input != '\0' && game_board.n_pacmans > 0) {
-                    game_board.pacmans[0].next_direction = input;
+                else if (input == 'M') {
+                    overlay ^= DRAW_METRICS;
+                    if (overlay) metrics_enable(1);
                 }
-
-                if (game_board.n_pacmans > 0 && !game_board.pacmans[0].alive) {
-                    game_board.game_running = 0;
-                    exit_reason = QUIT_GAME;
+                else if (input == 'U') {
+                    if (rewinding) {
+                        request_end(&game_board, engine_request, GAME_REWIND_REQUESTED);
+                    }
+                } 
+                else if (input != '\0') {
+                    // Cada jogador tem as suas teclas, traduzidas para WASD
+                    char command;
+                    int p = pacman_for_key(&game_board, input, &command);
+                    if (p >= 0 && input_queue_push(&game_board.pacmans[p].input, command) < 0)
+                        log_debug(LOG_CAT_MOVEMENT, "Input queue of pacman %d full, dropped %c\n", p, input);
                 }
+            }
 
-                if (game_board.n_pacmans > 0 && game_board.game_running == 0 && exit_reason == CONTINUE_PLAY) {
-                    if (game_board.pacmans[0].alive)
-                        exit_reason = NEXT_LEVEL;
-                    else
-                        exit_reason = QUIT_GAME;
-                }
+            // A primeira transição para fora de GAME_RUNNING é o motivo do fim da ronda
+            end_state = game_state(&game_board);
+            int exit_reason = exit_reason_for(end_state);
 
-                sleep_ms(game_board.tempo);
+            if (recording) {
+                pthread_join(engine_tid, NULL);
             }
 
-            if (exit_reason == CONTINUE_PLAY) {
-                if (game_board.n_pacmans > 0 && game_board.pacmans[0].alive)
-                    exit_reason = NEXT_LEVEL;
-                else
-                    exit_reason = QUIT_GAME;
+            for (int i = 0; agent_threads && i < game_board.n_pacmans; i++) {
+                pthread_join(pacman_tids[i], NULL);
             }
-
-            if (game_board.n_pacmans > 0) pthread_join(pacman_tid, NULL);
             
-            for (int i = 0; i < game_board.n_ghosts; i++) {
+            for (int i = 0; agent_threads && i < game_board.n_ghosts; i++) {
                 pthread_join(ghost_tids[i], NULL);
             }
 
+            for (int i = 0; i < game_board.n_pacmans; i++) {
+                if (game_board.pacmans[i].n_moves > 0) continue;
+                char name[32];
+                snprintf(name, sizeof(name), "Pacman %d", i);
+                input_queue_report(&game_board.pacmans[i].input, name);
+            }
+            if (recording) {
+                recorder_end(&recorder, &game_board, end_state);
+            }
+            // Os espectadores também veem como a ronda acabou
+            if (spectating) {
+                spectate_publish(&feed, &game_board);
+            }
+
             if (exit_reason == DO_BACKUP) {
-                pid_t pid = fork();
+                // Com todos os slots ocupados descarta-se o save mais antigo (reutilizando o buffer)
+                if (n_saves == MAX_SNAPSHOTS) {
+                    board_snapshot_t oldest = saves[0];
+                    memmove(&saves[0], &saves[1], (MAX_SNAPSHOTS - 1) * sizeof(board_snapshot_t));
+                    saves[MAX_SNAPSHOTS - 1] = oldest;
+                    n_saves--;
+                }
+                uint64_t start = now_ns();
+                if (snapshot_save(&saves[n_saves], &game_board) == 0) {
+                    n_saves++;
+                    if (recording) recorder_action(&recorder, &game_board, REC_SAVE);
+                    log_info(LOG_CAT_BACKUP, "Quicksave %d saved in %.3f ms\n", n_saves, (now_ns() - start) / 1e6);
+                } else {
+                    log_error(LOG_CAT_BACKUP, "Quicksave failed: out of memory\n");
+                }
+                continue;
+            }
 
-                if (pid < 0) {
-                    perror("Fork failed");
-                    exit_reason = CONTINUE_PLAY;
-                } 
-                else if (pid == 0) {
-                    has_backup = true;
-                    continue; 
-                } 
-                else {
-                    int status;
-                    wait(&status);
-
-                    if (WIFEXITED(status)) {
-                        int exit_code = WEXITSTATUS(status);
-
-                        if (exit_code == EXIT_PACMAN_DIED) {
-                            debug("Pacman morreu no filho. Restaurando estado...\n");
-                            screen_refresh(&game_board, DRAW_MENU);
-                            continue; 
-                        } 
-                        else if (exit_code == NEXT_LEVEL) {
-                            level_result = NEXT_LEVEL;
-                            break;
-                        } 
-                        else if (exit_code == QUIT_GAME) {
-                            level_result = QUIT_GAME;
-                            break;
-                        }
+            if (end_state == GAME_PACMAN_DEAD && n_saves > 0) {
+                uint64_t start = now_ns();
+                snapshot_restore(&saves[--n_saves], &game_board);
+                if (recording) recorder_action(&recorder, &game_board, REC_RESTORE);
+                log_info(LOG_CAT_BACKUP, "Pacman died. Quicksave %d restored in %.3f ms\n", n_saves + 1, (now_ns() - start) / 1e6);
+                // O journal só descreve passos contínuos, por isso o restauro leva a uma nova base
+                if (checkpointing) {
+                    checkpoint_base(&checkpoint, &game_board, level_path);
+                }
+                if (rewinding) {
+                    rewind_clear(&rewind, &game_board);
+                }
+                screen_refresh(&game_board, DRAW_MENU | overlay);
+                continue;
+            }
+
+            // Sem quicksaves, a morte (ou a tecla U) volta REWIND_TICKS atrás no histórico recente
+            if (rewinding && (exit_reason == DO_REWIND || end_state == GAME_PACMAN_DEAD)) {
+                uint64_t start = now_ns();
+                if (recording) recorder_action(&recorder, &game_board, REC_REWIND);
+                unsigned rewound = rewind_ticks(&rewind, &game_board, REWIND_TICKS);
+                log_info(LOG_CAT_BACKUP, "Rewound %u ticks in %.3f ms\n", rewound, (now_ns() - start) / 1e6);
+                if (rewound > 0 || exit_reason == DO_REWIND) {
+                    if (checkpointing) {
+                        checkpoint_base(&checkpoint, &game_board, level_path);
                     }
+                    screen_refresh(&game_board, DRAW_MENU | overlay);
                     continue;
                 }
             }
-            else {
-                level_result = exit_reason;
-                break;
-            }
+
+            level_result = exit_reason;
+            break;
         } 
 
         if (level_result == QUIT_GAME) {
-            if (!game_board.pacmans[0].alive) {
-                if (has_backup) {
-                    exit(EXIT_PACMAN_DIED);
-                }
-                screen_refresh(&game_board, DRAW_GAME_OVER);
-                sleep_ms(2000);
-                end_game = true;
-            } else {
-                if (has_backup) {
-                    exit(QUIT_GAME);
-                }
-                screen_refresh(&game_board, DRAW_GAME_OVER);
-                sleep_ms(2000);
-                end_game = true;
-            }
+            screen_refresh(&game_board, DRAW_GAME_OVER | overlay);
+            sleep_ms(2000);
+            end_game = true;
         } 
         else if (level_result == NEXT_LEVEL) {
-            accumulated_points = game_board.pacmans[0].points;
+            for (int i = 0; i < game_board.n_pacmans; i++) {
+                accumulated_points[i] = game_board.pacmans[i].points;
+            }
             if (index_lp >= cnt_lvl) {
-                draw_board(&game_board, DRAW_WIN);
+                draw_board(&game_board, DRAW_WIN | overlay);
                 refresh_screen();
                 sleep_ms(2000);
             }
-            
-            if (has_backup) {
-                exit(NEXT_LEVEL);
-            }
         }
 
+        if (heatmap) {
+            lock_profile_write(game_board.lock_profile, &game_board, heatmap);
+        }
         unload_level(&game_board);
     }
 
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        snapshot_free(&saves[i]);
+    }
+    if (checkpointing) {
+        checkpoint_close(&checkpoint);
+    }
+    if (rewinding) {
+        rewind_free(&rewind);
+    }
+    if (recording) {
+        recorder_close(&recorder);
+    }
+    if (spectating) {
+        spectate_close(&feed);
+    }
+
     if (lvl_paths) {
         for (int i = 0; i < cnt_lvl; i++) {
             free(lvl_paths[i]);
@@ -304,6 +671,9 @@ int main(int argc, char** argv) {
         free(lvl_paths);
     }
     terminal_cleanup();
+    if (heatmap) fclose(heatmap);
+    trace_write();
+    metrics_stop();
     close_debug_file();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "input_queue.h"
+#include "board.h"
+#include <time.h>
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void input_queue_init(input_queue_t* q, int depth) {
+    if (depth <= 0) depth = DEFAULT_INPUT_DEPTH;
+    if (depth > MAX_INPUT_DEPTH) depth = MAX_INPUT_DEPTH;
+    q->depth = depth;
+    atomic_store(&q->head, 0);
+    atomic_store(&q->tail, 0);
+    atomic_store(&q->dropped, 0);
+    q->lat_count = 0;
+    q->lat_total_ns = 0;
+    q->lat_min_ns = UINT64_MAX;
+    q->lat_max_ns = 0;
+}
+
+int input_queue_push(input_queue_t* q, char command) {
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (tail - head >= (unsigned)q->depth) {
+        atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    input_cmd_t* slot = &q->slots[tail & (MAX_INPUT_DEPTH - 1)];
+    slot->command = command;
+    slot->pushed_ns = now_ns();
+
+    // Publish the slot only after it is filled
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+int input_queue_pop(input_queue_t* q, input_cmd_t* out) {
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head == tail) {
+        return 0;
+    }
+
+    *out = q->slots[head & (MAX_INPUT_DEPTH - 1)];
+
+    // Hand the slot back to the producer only after it was copied
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 1;
+}
+
+void input_queue_record_latency(input_queue_t* q, const input_cmd_t* cmd) {
+    uint64_t latency = now_ns() - cmd->pushed_ns;
+    q->lat_count++;
+    q->lat_total_ns += latency;
+    if (latency < q->lat_min_ns) q->lat_min_ns = latency;
+    if (latency > q->lat_max_ns) q->lat_max_ns = latency;
+}
+
+void input_queue_report(input_queue_t* q, const char* name) {
+    if (q->lat_count == 0) {
+        log_info(LOG_CAT_MOVEMENT, "%s input: no commands applied, %u dropped\n", name, atomic_load(&q->dropped));
+        return;
+    }
+    log_info(LOG_CAT_MOVEMENT, "%s input: %u commands applied, %u dropped, latency min/avg/max = %.3f/%.3f/%.3f ms (depth %d)\n",
+          name, q->lat_count, atomic_load(&q->dropped),
+          q->lat_min_ns / 1e6, (double)q->lat_total_ns / q->lat_count / 1e6, q->lat_max_ns / 1e6, q->depth);
+}
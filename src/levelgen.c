@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+// Procedural generator of .lvl/.m/.p files in the format read by load_level_file. Everything
+// follows from the seed: the same options always write the same files
+
+#define MAX_DIM 16384
+#define MAX_GEN_GHOSTS 100000
+#define MAX_PORTALS 1024
+#define MAX_GEN_PACMANS 8   // MAX_PACMANS of the loader
+
+typedef enum { PORTALS_CORNER = 0, PORTALS_RANDOM, PORTALS_CENTER } portal_mode_t;
+
+typedef struct {
+    uint64_t seed;
+    int width, height;
+    int density;        // % of the inner cells that are walls
+    int dot_ratio;      // % of the free cells that have a dot
+    int n_portals;
+    portal_mode_t portal_mode;
+    int n_ghosts;
+    int script_len;     // commands in each .m/.p script
+    int n_levels;
+    int tempo;
+    int n_pacmans;
+    int keyboard;       // the pacmans are played with the keyboard (no .p file when there is one)
+    const char* prefix;
+    const char* out_dir;
+} gen_options_t;
+
+typedef struct {
+    int x, y;
+} pos_t;
+
+// splitmix64: a full-period generator whose output is also a good hash of its input
+static uint64_t mix(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rng_state;
+
+static uint64_t next_random() {
+    rng_state += 0x9e3779b97f4a7c15ull;
+    return mix(rng_state);
+}
+
+static int random_below(int n) {
+    return (int)(next_random() % (uint64_t)n);
+}
+
+// Per-cell decisions are a hash of (level seed, cell, purpose) rather than a stream of random
+// numbers, so any cell can be asked about without keeping the board in memory
+static int cell_percent(uint64_t level_seed, int x, int y, int purpose) {
+    return (int)(mix(level_seed ^ mix(((uint64_t)y << 32 | (uint32_t)x) * 4 + purpose)) % 100);
+}
+
+static int is_wall(const gen_options_t* opt, uint64_t level_seed, int x, int y) {
+    if (x == 0 || y == 0 || x == opt->width - 1 || y == opt->height - 1) return 1;
+    if (x == 1 && y == 1) return 0;     // pacman start
+    return cell_percent(level_seed, x, y, 0) < opt->density;
+}
+
+// Open addressing set of occupied cells (pacman, portals and ghosts)
+typedef struct {
+    uint64_t* keys;     // y * width + x + 1, 0 for an empty slot
+    size_t mask;
+} pos_set_t;
+
+static int pos_set_init(pos_set_t* set, size_t expected) {
+    size_t cap = 64;
+    while (cap < expected * 2) cap *= 2;
+    set->keys = calloc(cap, sizeof(uint64_t));
+    set->mask = cap - 1;
+    return set->keys ? 0 : -1;
+}
+
+// Inserts the cell, returns 0 if it was already there
+static int pos_set_add(pos_set_t* set, uint64_t cell) {
+    uint64_t key = cell + 1;
+    for (size_t i = mix(key) & set->mask; ; i = (i + 1) & set->mask) {
+        if (set->keys[i] == key) return 0;
+        if (set->keys[i] == 0) {
+            set->keys[i] = key;
+            return 1;
+        }
+    }
+}
+
+// Picks a free cell not in 'used', or returns -1 after too many tries (board mostly walls/full)
+static int pick_free_cell(const gen_options_t* opt, uint64_t level_seed, pos_set_t* used, pos_t* out) {
+    for (int tries = 0; tries < 1000; tries++) {
+        int x = 1 + random_below(opt->width - 2);
+        int y = 1 + random_below(opt->height - 2);
+        if (is_wall(opt, level_seed, x, y)) continue;
+        if (!pos_set_add(used, (uint64_t)y * opt->width + x)) continue;
+        out->x = x;
+        out->y = y;
+        return 0;
+    }
+    return -1;
+}
+
+// Nearest free cell to (x, y) not in 'used', searching rings of growing radius
+static int nearest_free_cell(const gen_options_t* opt, uint64_t level_seed, pos_set_t* used, int x, int y, pos_t* out) {
+    int max_r = opt->width > opt->height ? opt->width : opt->height;
+    for (int r = 0; r < max_r; r++) {
+        for (int dy = -r; dy <= r; dy++) {
+            for (int dx = -r; dx <= r; dx++) {
+                if (abs(dx) != r && abs(dy) != r) continue;
+                int cx = x + dx, cy = y + dy;
+                if (cx < 1 || cy < 1 || cx > opt->width - 2 || cy > opt->height - 2) continue;
+                if (is_wall(opt, level_seed, cx, cy)) continue;
+                if (!pos_set_add(used, (uint64_t)cy * opt->width + cx)) continue;
+                out->x = cx;
+                out->y = cy;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+static int compare_pos(const void* a, const void* b) {
+    const pos_t* p = a;
+    const pos_t* q = b;
+    if (p->y != q->y) return p->y < q->y ? -1 : 1;
+    return (p->x > q->x) - (p->x < q->x);
+}
+
+// Chooses where the portals go; returns how many could be placed
+static int place_portals(const gen_options_t* opt, uint64_t level_seed, pos_set_t* used, pos_t* portals) {
+    int placed = 0;
+    for (int i = 0; i < opt->n_portals; i++) {
+        pos_t p;
+        int found;
+        if (opt->portal_mode == PORTALS_RANDOM) {
+            found = pick_free_cell(opt, level_seed, used, &p);
+        } else if (opt->portal_mode == PORTALS_CENTER) {
+            found = nearest_free_cell(opt, level_seed, used, opt->width / 2, opt->height / 2, &p);
+        } else {
+            // far corner first, then the other two corners the pacman does not start in
+            static const int corners[3][2] = { { 1, 1 }, { 0, 1 }, { 1, 0 } };
+            int cx = corners[i % 3][0] ? opt->width - 2 : 1;
+            int cy = corners[i % 3][1] ? opt->height - 2 : 1;
+            found = nearest_free_cell(opt, level_seed, used, cx, cy, &p);
+        }
+        if (found < 0) break;
+        portals[placed++] = p;
+    }
+    qsort(portals, placed, sizeof(pos_t), compare_pos);
+    return placed;
+}
+
+// Writes the rows one at a time, so memory does not depend on the board size
+static void write_rows(FILE* f, const gen_options_t* opt, uint64_t level_seed, const pos_t* portals, int n_portals) {
+    char* row = malloc(opt->width + 1);
+    if (!row) return;
+    int next_portal = 0;
+    for (int y = 0; y < opt->height; y++) {
+        for (int x = 0; x < opt->width; x++) {
+            if (next_portal < n_portals && portals[next_portal].y == y && portals[next_portal].x == x) {
+                row[x] = '@';
+                next_portal++;
+            } else if (is_wall(opt, level_seed, x, y)) {
+                row[x] = 'X';
+            } else if (cell_percent(level_seed, x, y, 1) < opt->dot_ratio || (x == 1 && y == 1)) {
+                row[x] = 'o';
+            } else {
+                row[x] = ' ';   // free cell without a dot (any other character reads as one)
+            }
+        }
+        row[opt->width] = '\n';
+        fwrite(row, 1, opt->width + 1, f);
+    }
+    free(row);
+}
+
+// Writes a .m (ghost) or .p (pacman) script starting at 'pos'
+static int write_script(const char* path, pos_t pos, int length, int ghost) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "PASSO %d\nPOS %d %d\n", random_below(4), pos.y, pos.x);
+    for (int i = 0; i < length; i++) {
+        int r = random_below(100);
+        if (r < 70) fprintf(f, "%c\n", "WASD"[r % 4]);
+        else if (r < 85) fprintf(f, "%c\n", ghost ? 'R' : "WASD"[r % 4]);
+        else if (r < 95 || !ghost) fprintf(f, "T %d\n", 1 + random_below(5));
+        else fprintf(f, "C\n");
+    }
+    fclose(f);
+    return 0;
+}
+
+// Writes a .p script that hands the pacman at 'pos' to the keyboard
+static int write_keys_script(const char* path, pos_t pos) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "PASSO 0\nPOS %d %d\nKEYS\n", pos.y, pos.x);
+    fclose(f);
+    return 0;
+}
+
+static int generate_level(const gen_options_t* opt, int level) {
+    uint64_t level_seed = mix(opt->seed * 1000003u + level);
+    rng_state = level_seed;
+
+    char path[4096];
+    char name[256];
+    pos_set_t used;
+    pos_t* portals = malloc(sizeof(pos_t) * (opt->n_portals > 0 ? opt->n_portals : 1));
+    if (!portals || pos_set_init(&used, (size_t)opt->n_ghosts + opt->n_portals + opt->n_pacmans) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        free(portals);
+        return -1;
+    }
+    pos_set_add(&used, (uint64_t)opt->width + 1);  // pacman start (1, 1)
+    int n_portals = place_portals(opt, level_seed, &used, portals);
+
+    snprintf(path, sizeof(path), "%s/%s%d.lvl", opt->out_dir, opt->prefix, level);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        free(portals);
+        free(used.keys);
+        return -1;
+    }
+    fprintf(f, "# generated by levelgen: seed %llu, level %d, density %d%%, dots %d%%\n",
+            (unsigned long long)opt->seed, level, opt->density, opt->dot_ratio);
+    fprintf(f, "DIM %d %d\nTEMPO %d\n", opt->width, opt->height, opt->tempo);
+
+    // The first pacman starts at (1, 1), the others on free cells
+    if (!opt->keyboard || opt->n_pacmans > 1) {
+        fprintf(f, "PAC");
+        for (int p = 0; p < opt->n_pacmans; p++) {
+            pos_t pos = { 1, 1 };
+            if (p > 0 && pick_free_cell(opt, level_seed, &used, &pos) < 0) break;
+            if (p == 0) snprintf(name, sizeof(name), "%s%d.p", opt->prefix, level);
+            else snprintf(name, sizeof(name), "%s%d_%d.p", opt->prefix, level, p);
+            snprintf(path, sizeof(path), "%s/%s", opt->out_dir, name);
+            int written = opt->keyboard ? write_keys_script(path, pos) : write_script(path, pos, opt->script_len, 0);
+            if (written < 0) {
+                fclose(f);
+                free(portals);
+                free(used.keys);
+                return -1;
+            }
+            fprintf(f, " %s", name);
+        }
+        fprintf(f, "\n");
+    }
+
+    int ghosts = 0;
+    if (opt->n_ghosts > 0) {
+        fprintf(f, "MON");
+        for (int g = 0; g < opt->n_ghosts; g++) {
+            pos_t pos;
+            if (pick_free_cell(opt, level_seed, &used, &pos) < 0) break;
+            snprintf(name, sizeof(name), "%s%d_%d.m", opt->prefix, level, g);
+            snprintf(path, sizeof(path), "%s/%s", opt->out_dir, name);
+            if (write_script(path, pos, opt->script_len, 1) < 0) break;
+            fprintf(f, " %s", name);
+            ghosts++;
+        }
+        fprintf(f, "\n");
+    }
+
+    write_rows(f, opt, level_seed, portals, n_portals);
+    int failed = ferror(f);
+    fclose(f);
+    free(portals);
+    free(used.keys);
+
+    printf("%s/%s%d.lvl: %dx%d, %d portals, %d ghosts\n", opt->out_dir, opt->prefix, level,
+           opt->width, opt->height, n_portals, ghosts);
+    if (ghosts < opt->n_ghosts) {
+        fprintf(stderr, "Only %d of %d ghosts fit in level %d\n", ghosts, opt->n_ghosts, level);
+    }
+    return failed ? -1 : 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [options] <output_dir>\n", prog);
+    fprintf(stderr, "  -s seed         seed for everything generated (default 1)\n");
+    fprintf(stderr, "  -W width        board width, 3-%d (default 64)\n", MAX_DIM);
+    fprintf(stderr, "  -H height       board height, 3-%d (default 64)\n", MAX_DIM);
+    fprintf(stderr, "  -d density      %% of the inner cells that are walls (default 25)\n");
+    fprintf(stderr, "  -o dot_ratio    %% of the free cells with a dot (default 100)\n");
+    fprintf(stderr, "  -P portals      number of portals, 0-%d (default 1)\n", MAX_PORTALS);
+    fprintf(stderr, "  -p placement    corner, random or center (default corner)\n");
+    fprintf(stderr, "  -g ghosts       ghosts per level, 0-%d (default 4)\n", MAX_GEN_GHOSTS);
+    fprintf(stderr, "  -l length       commands in each ghost/pacman script (default 10)\n");
+    fprintf(stderr, "  -n levels       number of levels (default 1)\n");
+    fprintf(stderr, "  -t tempo        TEMPO of the levels in ms (default 10)\n");
+    fprintf(stderr, "  -a pacmans      pacmans per level, 1-%d (default 1)\n", MAX_GEN_PACMANS);
+    fprintf(stderr, "  -k              the pacmans are played with the keyboard (WASD, IJKL, 8456)\n");
+    fprintf(stderr, "  -f prefix       file name prefix (default gen)\n");
+}
+
+// Parses an integer option in [min, max]
+static int parse_int(const char* arg, int min, int max, int* out) {
+    char* end;
+    errno = 0;
+    long v = strtol(arg, &end, 10);
+    if (errno || *end != '\0' || v < min || v > max) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    gen_options_t opt = {
+        .seed = 1, .width = 64, .height = 64, .density = 25, .dot_ratio = 100,
+        .n_portals = 1, .portal_mode = PORTALS_CORNER, .n_ghosts = 4, .script_len = 10,
+        .n_levels = 1, .tempo = 10, .n_pacmans = 1, .keyboard = 0, .prefix = "gen",
+    };
+    int c, bad = 0;
+    while ((c = getopt(argc, argv, "s:W:H:d:o:P:p:g:l:n:t:a:kf:")) != -1) {
+        switch (c) {
+            case 's': opt.seed = strtoull(optarg, NULL, 10); break;
+            case 'W': bad |= parse_int(optarg, 3, MAX_DIM, &opt.width); break;
+            case 'H': bad |= parse_int(optarg, 3, MAX_DIM, &opt.height); break;
+            case 'd': bad |= parse_int(optarg, 0, 100, &opt.density); break;
+            case 'o': bad |= parse_int(optarg, 0, 100, &opt.dot_ratio); break;
+            case 'P': bad |= parse_int(optarg, 0, MAX_PORTALS, &opt.n_portals); break;
+            case 'p':
+                if (strcmp(optarg, "corner") == 0) opt.portal_mode = PORTALS_CORNER;
+                else if (strcmp(optarg, "random") == 0) opt.portal_mode = PORTALS_RANDOM;
+                else if (strcmp(optarg, "center") == 0) opt.portal_mode = PORTALS_CENTER;
+                else bad = -1;
+                break;
+            case 'g': bad |= parse_int(optarg, 0, MAX_GEN_GHOSTS, &opt.n_ghosts); break;
+            case 'l': bad |= parse_int(optarg, 1, 1 << 20, &opt.script_len); break;
+            case 'n': bad |= parse_int(optarg, 1, 1000, &opt.n_levels); break;
+            case 't': bad |= parse_int(optarg, 1, 100000, &opt.tempo); break;
+            case 'a': bad |= parse_int(optarg, 1, MAX_GEN_PACMANS, &opt.n_pacmans); break;
+            case 'k': opt.keyboard = 1; break;
+            case 'f': opt.prefix = optarg; break;
+            default: bad = -1; break;
+        }
+    }
+    if (bad || argc - optind != 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    opt.out_dir = argv[optind];
+    if (mkdir(opt.out_dir, 0755) < 0 && errno != EEXIST) {
+        perror(opt.out_dir);
+        return EXIT_FAILURE;
+    }
+
+    for (int level = 1; level <= opt.n_levels; level++) {
+        if (generate_level(&opt, level) < 0) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
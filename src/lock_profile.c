@@ -0,0 +1,198 @@
+#include "lock_profile.h"
+#include <stdlib.h>
+
+#define TOP_CELLS 10
+#define HELD_MAX 4      // cells one thread holds at once (lock_positions takes two)
+
+// When each cell the thread holds was locked, for the hold time
+static _Thread_local struct {
+    int index;
+    uint64_t at;
+} held[HELD_MAX];
+static _Thread_local int n_held;
+
+lock_profile_t* lock_profile_create(int width, int height) {
+    lock_profile_t* prof = calloc(1, sizeof(lock_profile_t));
+    if (!prof) return NULL;
+    prof->width = width;
+    prof->height = height;
+    prof->region = 1;
+    while (prof->region < LOCK_REGION_MAX &&
+           ((width + prof->region - 1) / prof->region > LOCK_MAP_MAX ||
+            (height + prof->region - 1) / prof->region > LOCK_MAP_MAX)) {
+        prof->region *= 2;
+    }
+    prof->regions_x = (width + prof->region - 1) / prof->region;
+    prof->regions_y = (height + prof->region - 1) / prof->region;
+    prof->regions = calloc((size_t)prof->regions_x * prof->regions_y, sizeof(lock_stats_t));
+    prof->hot = calloc(LOCK_HOT_CELLS, sizeof(lock_hot_cell_t));
+    if (!prof->regions || !prof->hot) {
+        lock_profile_free(prof);
+        return NULL;
+    }
+    return prof;
+}
+
+static lock_stats_t* region_of(lock_profile_t* prof, int index) {
+    int x = index % prof->width / prof->region;
+    int y = index / prof->width / prof->region;
+    return &prof->regions[y * prof->regions_x + x];
+}
+
+// Slot of cell 'index' in the hot table; with 'claim' a free slot is taken for it. NULL when
+// the cell is not tracked (or no slot was free within LOCK_HOT_PROBES)
+static lock_hot_cell_t* hot_cell(lock_profile_t* prof, int index, int claim) {
+    unsigned h = (unsigned)index * 2654435761u % LOCK_HOT_CELLS;
+    for (int p = 0; p < LOCK_HOT_PROBES; p++) {
+        lock_hot_cell_t* slot = &prof->hot[(h + p) % LOCK_HOT_CELLS];
+        int key = atomic_load_explicit(&slot->index, memory_order_acquire);
+        if (key == index + 1) return slot;
+        if (key != 0) continue;
+        if (!claim) return NULL;
+        if (atomic_compare_exchange_strong(&slot->index, &key, index + 1) || key == index + 1) return slot;
+    }
+    return NULL;
+}
+
+static void add_stats(lock_stats_t* stats, uint64_t contended, uint64_t wait) {
+    atomic_fetch_add_explicit(&stats->acquisitions, 1, memory_order_relaxed);
+    if (contended) {
+        atomic_fetch_add_explicit(&stats->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->wait_ns, wait, memory_order_relaxed);
+    }
+}
+
+void lock_profile_acquire(lock_profile_t* prof, pthread_mutex_t* mutex, int index) {
+    uint64_t wait = 0;
+    int contended = pthread_mutex_trylock(mutex) != 0;
+    if (contended) {
+        uint64_t start = now_ns();
+        pthread_mutex_lock(mutex);
+        wait = now_ns() - start;
+    }
+    add_stats(region_of(prof, index), contended, wait);
+    lock_hot_cell_t* hot = hot_cell(prof, index, contended);
+    if (hot) add_stats(&hot->stats, contended, wait);
+    else if (contended) atomic_fetch_add_explicit(&prof->hot_dropped, 1, memory_order_relaxed);
+
+    if (n_held < HELD_MAX) {
+        held[n_held].index = index;
+        held[n_held++].at = now_ns();
+    }
+}
+
+void lock_profile_release(lock_profile_t* prof, pthread_mutex_t* mutex, int index) {
+    for (int i = 0; i < n_held; i++) {
+        if (held[i].index != index) continue;
+        uint64_t hold = now_ns() - held[i].at;
+        held[i] = held[--n_held];
+        atomic_fetch_add_explicit(&region_of(prof, index)->hold_ns, hold, memory_order_relaxed);
+        lock_hot_cell_t* hot = hot_cell(prof, index, 0);
+        if (hot) atomic_fetch_add_explicit(&hot->stats.hold_ns, hold, memory_order_relaxed);
+        break;
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+// Number of significant bits, a cheap log2 for the heatmap scale
+static int bit_length(uint64_t v) {
+    return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+// Whether every cell of region (rx, ry) is a wall
+static int region_is_wall(lock_profile_t* prof, board_t* board, int rx, int ry) {
+    for (int y = ry * prof->region; y < (ry + 1) * prof->region && y < prof->height; y++) {
+        for (int x = rx * prof->region; x < (rx + 1) * prof->region && x < prof->width; x++) {
+            if (board->cells[y * prof->width + x] != 'W') return 0;
+        }
+    }
+    return 1;
+}
+
+// Draws one plane of region totals as digits 1-9 on a log2 scale of the maximum; regions never
+// locked show '#' when they are all wall or stay blank
+static void write_heatmap(lock_profile_t* prof, board_t* board, FILE* out, const char* title, int hold) {
+    uint64_t max = 0;
+    int regions = prof->regions_x * prof->regions_y;
+    for (int i = 0; i < regions; i++) {
+        uint64_t v = atomic_load(hold ? &prof->regions[i].hold_ns : &prof->regions[i].wait_ns);
+        if (v > max) max = v;
+    }
+    fprintf(out, "--- %s (9 = %.1f us, '.' = locked but 0) ---\n", title, max / 1e3);
+
+    for (int ry = 0; ry < prof->regions_y; ry++) {
+        for (int rx = 0; rx < prof->regions_x; rx++) {
+            lock_stats_t* region = &prof->regions[ry * prof->regions_x + rx];
+            uint64_t v = atomic_load(hold ? &region->hold_ns : &region->wait_ns);
+            char c;
+            if (atomic_load(&region->acquisitions) == 0) c = region_is_wall(prof, board, rx, ry) ? '#' : ' ';
+            else if (v == 0 || max == 0) c = '.';
+            else c = '1' + 8 * bit_length(v) / bit_length(max);
+            fputc(c, out);
+        }
+        fputc('\n', out);
+    }
+}
+
+void lock_profile_write(lock_profile_t* prof, board_t* board, FILE* out) {
+    if (!prof || !out) return;
+
+    uint64_t acquisitions = 0, contended = 0, wait = 0;
+    int regions = prof->regions_x * prof->regions_y;
+    for (int i = 0; i < regions; i++) {
+        acquisitions += atomic_load(&prof->regions[i].acquisitions);
+        contended += atomic_load(&prof->regions[i].contended);
+        wait += atomic_load(&prof->regions[i].wait_ns);
+    }
+    fprintf(out, "=== LOCK PROFILE %s (%dx%d, regions of %dx%d cells) ===\n", board->level_name,
+            prof->width, prof->height, prof->region, prof->region);
+    fprintf(out, "%llu acquisitions, %llu contended (%.2f%%), %.1f us waiting in total\n",
+            (unsigned long long)acquisitions, (unsigned long long)contended,
+            acquisitions ? 100.0 * contended / acquisitions : 0.0, wait / 1e3);
+
+    write_heatmap(prof, board, out, "wait time", 0);
+    write_heatmap(prof, board, out, "hold time", 1);
+
+    // Most waited-on cells, picked by repeated selection since only a handful are printed. The
+    // counters of a cell start at its first contention
+    fprintf(out, "--- top cells by wait time (counted from their first contention) ---\n");
+    fprintf(out, "%8s %8s %12s %10s %12s %12s\n", "x", "y", "acquisitions", "contended", "wait_us", "hold_us");
+    uint64_t last = UINT64_MAX;
+    int last_index = -1;
+    for (int n = 0; n < TOP_CELLS; n++) {
+        lock_hot_cell_t* best = NULL;
+        uint64_t best_wait = 0;
+        int best_index = -1;
+        for (int s = 0; s < LOCK_HOT_CELLS; s++) {
+            int i = atomic_load(&prof->hot[s].index) - 1;
+            if (i < 0) continue;
+            uint64_t w = atomic_load(&prof->hot[s].stats.wait_ns);
+            if (w == 0) continue;
+            // strictly after the previous pick in (wait desc, index asc) order
+            if (w > last || (w == last && i <= last_index)) continue;
+            if (!best || w > best_wait || (w == best_wait && i < best_index)) {
+                best = &prof->hot[s];
+                best_wait = w;
+                best_index = i;
+            }
+        }
+        if (!best) break;
+        fprintf(out, "%8d %8d %12llu %10llu %12.1f %12.1f\n", best_index % prof->width, best_index / prof->width,
+                (unsigned long long)atomic_load(&best->stats.acquisitions),
+                (unsigned long long)atomic_load(&best->stats.contended),
+                best_wait / 1e3, atomic_load(&best->stats.hold_ns) / 1e3);
+        last = best_wait;
+        last_index = best_index;
+    }
+    unsigned dropped = atomic_load(&prof->hot_dropped);
+    if (dropped > 0) fprintf(out, "(%u contentions on cells the table had no room for)\n", dropped);
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+void lock_profile_free(lock_profile_t* prof) {
+    if (!prof) return;
+    free(prof->regions);
+    free(prof->hot);
+    free(prof);
+}
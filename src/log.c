@@ -0,0 +1,281 @@
+#include "log.h"
+#include "input_queue.h"
+#include "affinity.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+static const char* level_names[] = { "trace", "debug", "info", "warn", "error", "off" };
+static const char* category_names[] = { "loader", "movement", "render", "backup" };
+
+int log_levels[LOG_N_CATEGORIES] = { LOG_LEVEL_DEBUG, LOG_LEVEL_DEBUG, LOG_LEVEL_DEBUG, LOG_LEVEL_DEBUG };
+
+static FILE* debugfile;
+static atomic_int log_open;
+static uint64_t log_epoch_ns;
+
+static log_ring_t rings[LOG_MAX_THREADS];   // in BSS, so rings never used cost no memory
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static atomic_uint next_tid;
+
+static pthread_t flusher_tid;
+static atomic_int flusher_stop;
+
+static _Thread_local log_ring_t* my_ring;
+static _Thread_local uint32_t my_tid;
+static _Thread_local char scratch[LOG_LINE_MAX];
+
+// Runs when a thread that logged exits, so the next thread can take its ring over
+static void release_ring(void* ring) {
+    atomic_store_explicit(&((log_ring_t*)ring)->in_use, 0, memory_order_release);
+}
+
+static void make_ring_key() {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Ring of the calling thread, claiming a free one on its first message (NULL if all are taken)
+static log_ring_t* thread_ring() {
+    if (my_ring) return my_ring;
+
+    pthread_once(&ring_key_once, make_ring_key);
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&rings[i].in_use, &expected, 1,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            my_ring = &rings[i];
+            pthread_setspecific(ring_key, my_ring);
+            return my_ring;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t thread_id() {
+    if (my_tid == 0) my_tid = atomic_fetch_add(&next_tid, 1) + 1;
+    return my_tid;
+}
+
+static void ring_write(log_ring_t* ring, size_t pos, const void* src, size_t len) {
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t first = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+    memcpy(ring->data + off, src, first);
+    memcpy(ring->data, (const char*)src + first, len - first);
+}
+
+static void ring_read(const log_ring_t* ring, size_t pos, void* dst, size_t len) {
+    size_t off = pos & (LOG_RING_SIZE - 1);
+    size_t first = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+    memcpy(dst, ring->data + off, first);
+    memcpy((char*)dst + first, ring->data, len - first);
+}
+
+static void write_prefix(uint64_t ts_ns, uint32_t tid) {
+    uint64_t rel = ts_ns > log_epoch_ns ? ts_ns - log_epoch_ns : 0;
+    fprintf(debugfile, "[%6llu.%06llu] [T%u] ", (unsigned long long)(rel / 1000000000ull),
+            (unsigned long long)(rel / 1000 % 1000000), tid);
+}
+
+// Writes every record published so far, merging the rings by timestamp. Whoever holds the
+// file lock is the only reader, so the heads are read after taking it
+static void drain_rings() {
+    static char text[LOG_LINE_MAX];
+    size_t heads[LOG_MAX_THREADS], tails[LOG_MAX_THREADS];
+
+    flockfile(debugfile);
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        heads[i] = atomic_load_explicit(&rings[i].head, memory_order_relaxed);
+        tails[i] = atomic_load_explicit(&rings[i].tail, memory_order_acquire);
+    }
+    while (1) {
+        int next = -1;
+        log_record_t oldest, rec;
+        for (int i = 0; i < LOG_MAX_THREADS; i++) {
+            if (heads[i] == tails[i]) continue;
+            ring_read(&rings[i], heads[i], &rec, sizeof(log_record_t));
+            if (next < 0 || rec.ts_ns < oldest.ts_ns) {
+                next = i;
+                oldest = rec;
+            }
+        }
+        if (next < 0) break;
+
+        ring_read(&rings[next], heads[next] + sizeof(log_record_t), text, oldest.len);
+        write_prefix(oldest.ts_ns, oldest.tid);
+        fwrite(text, 1, oldest.len, debugfile);
+
+        heads[next] += (sizeof(log_record_t) + oldest.len + 7) & ~(size_t)7;
+        atomic_store_explicit(&rings[next].head, heads[next], memory_order_release);
+    }
+
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        unsigned dropped = atomic_load_explicit(&rings[i].dropped, memory_order_relaxed);
+        if (dropped != rings[i].reported) {
+            fprintf(debugfile, "[log] %u messages dropped, ring %d was full\n", dropped - rings[i].reported, i);
+            rings[i].reported = dropped;
+        }
+    }
+    fflush(debugfile);
+    funlockfile(debugfile);
+}
+
+static void* flusher_task(void* arg) {
+    (void)arg;
+    struct timespec interval = { 0, LOG_FLUSH_MS * 1000000L };
+    affinity_pin(affinity_slot(AFFINITY_LOGGER, 0, 0));
+    while (!atomic_load(&flusher_stop)) {
+        nanosleep(&interval, NULL);
+        drain_rings();
+    }
+    drain_rings();
+    return NULL;
+}
+
+void open_debug_file(char *filename) {
+    debugfile = fopen(filename, "w");
+    if (!debugfile) return;
+
+    log_epoch_ns = now_ns();
+    atomic_store(&flusher_stop, 0);
+    if (pthread_create(&flusher_tid, NULL, flusher_task, NULL) != 0) {
+        fclose(debugfile);
+        debugfile = NULL;
+        return;
+    }
+    atomic_store(&log_open, 1);
+}
+
+void close_debug_file() {
+    if (!atomic_load(&log_open)) return;
+    atomic_store(&log_open, 0);
+
+    atomic_store(&flusher_stop, 1);
+    pthread_join(flusher_tid, NULL);
+    fclose(debugfile);
+    debugfile = NULL;
+}
+
+// Formats 'tag' (may be empty) and the message into the calling thread's ring
+static void log_vwrite(const char* tag, const char * format, va_list args) {
+    if (!atomic_load_explicit(&log_open, memory_order_relaxed)) return;
+
+    log_ring_t* ring = thread_ring();
+    log_record_t rec = { .tid = thread_id() };
+
+    int t = snprintf(scratch, LOG_LINE_MAX, "%s", tag);
+    int n = vsnprintf(scratch + t, LOG_LINE_MAX - t, format, args);
+    if (n < 0) return;
+    n += t;
+    rec.len = n < LOG_LINE_MAX ? n : LOG_LINE_MAX - 1;
+    rec.ts_ns = now_ns();
+
+    // More threads than rings: fall back to writing directly
+    if (!ring) {
+        flockfile(debugfile);
+        write_prefix(rec.ts_ns, rec.tid);
+        fwrite(scratch, 1, rec.len, debugfile);
+        funlockfile(debugfile);
+        return;
+    }
+
+    size_t need = (sizeof(log_record_t) + rec.len + 7) & ~(size_t)7;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail + need - head > LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    ring_write(ring, tail, &rec, sizeof(log_record_t));
+    ring_write(ring, tail + sizeof(log_record_t), scratch, rec.len);
+    atomic_store_explicit(&ring->tail, tail + need, memory_order_release);
+}
+
+void debug(const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_vwrite("", format, args);
+    va_end(args);
+}
+
+void log_write(log_level_t level, log_category_t cat, const char * format, ...) {
+    char tag[32];
+    snprintf(tag, sizeof(tag), "%s/%s: ", category_names[cat], level_names[level]);
+    va_list args;
+    va_start(args, format);
+    log_vwrite(tag, format, args);
+    va_end(args);
+}
+
+static int parse_level(const char* name, size_t len) {
+    for (int i = 0; i <= LOG_LEVEL_OFF; i++) {
+        if (strlen(level_names[i]) == len && strncmp(name, level_names[i], len) == 0) return i;
+    }
+    return -1;
+}
+
+static int parse_category(const char* name, size_t len) {
+    for (int i = 0; i < LOG_N_CATEGORIES; i++) {
+        if (strlen(category_names[i]) == len && strncmp(name, category_names[i], len) == 0) return i;
+    }
+    return -1;
+}
+
+int log_configure(const char* spec) {
+    int levels[LOG_N_CATEGORIES];
+    memcpy(levels, log_levels, sizeof(levels));
+
+    const char* item = spec;
+    while (*item) {
+        size_t len = strcspn(item, ",");
+        const char* eq = memchr(item, '=', len);
+        if (eq) {
+            int cat = parse_category(item, eq - item);
+            int level = parse_level(eq + 1, len - (eq + 1 - item));
+            if (cat < 0 || level < 0) return -1;
+            levels[cat] = level;
+        } else {
+            int level = parse_level(item, len);
+            if (level < 0) return -1;
+            for (int i = 0; i < LOG_N_CATEGORIES; i++) levels[i] = level;
+        }
+        item += len;
+        if (*item == ',') item++;
+    }
+
+    memcpy(log_levels, levels, sizeof(levels));
+    return 0;
+}
+
+void debug_sync(const char * format, ...) {
+    if (!atomic_load_explicit(&log_open, memory_order_relaxed)) return;
+
+    flockfile(debugfile);
+    write_prefix(now_ns(), thread_id());
+    va_list args;
+    va_start(args, format);
+    vfprintf(debugfile, format, args);
+    va_end(args);
+    fflush(debugfile);
+    funlockfile(debugfile);
+}
+
+FILE* debug_stream_begin() {
+    if (!atomic_load_explicit(&log_open, memory_order_relaxed)) return NULL;
+
+    // flockfile is recursive, so drain_rings can take it again; earlier messages go first
+    flockfile(debugfile);
+    drain_rings();
+    write_prefix(now_ns(), thread_id());
+    return debugfile;
+}
+
+void debug_stream_end(FILE* stream) {
+    if (!stream) return;
+    fflush(stream);
+    funlockfile(stream);
+}
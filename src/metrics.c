@@ -0,0 +1,200 @@
+#include "metrics.h"
+#include "input_queue.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+static const char* counter_names[] = {
+    "pacman_moves", "ghost_moves", "invalid_moves", "deaths", "ticks", "tick_overruns"
+};
+static const char* hist_names[] = { "move_ns", "lock_hold_ns", "tick_ns" };
+
+atomic_int metrics_enabled;
+_Thread_local metrics_slot_t* metrics_slot;
+_Thread_local unsigned metrics_sample_seq;
+
+static metrics_slot_t slots[METRICS_MAX_THREADS];
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+static FILE* stats_file;
+static uint64_t stats_epoch_ns;
+static pthread_t dumper_tid;
+static pthread_mutex_t dumper_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dumper_cond = PTHREAD_COND_INITIALIZER;
+static int dumper_stop;     // guarded by dumper_mutex
+
+// Runs when a thread that recorded metrics exits; its counts stay in the slot for the next owner
+static void release_slot(void* slot) {
+    atomic_store_explicit(&((metrics_slot_t*)slot)->in_use, 0, memory_order_release);
+}
+
+static void make_slot_key() {
+    pthread_key_create(&slot_key, release_slot);
+}
+
+metrics_slot_t* metrics_claim_slot() {
+    pthread_once(&slot_key_once, make_slot_key);
+    for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&slots[i].in_use, &expected, 1,
+                                                    memory_order_acquire, memory_order_relaxed)) {
+            metrics_slot = &slots[i];
+            pthread_setspecific(slot_key, metrics_slot);
+            return metrics_slot;
+        }
+    }
+    return NULL;
+}
+
+void metrics_enable(int on) {
+    atomic_store(&metrics_enabled, on);
+}
+
+void metrics_collect(metrics_totals_t* out) {
+    memset(out, 0, sizeof(metrics_totals_t));
+    for (int i = 0; i < METRICS_MAX_THREADS; i++) {
+        for (int c = 0; c < METRIC_N_COUNTERS; c++)
+            out->counters[c] += atomic_load_explicit(&slots[i].counters[c], memory_order_relaxed);
+        for (int h = 0; h < METRIC_N_HISTOGRAMS; h++)
+            for (int b = 0; b < METRICS_BUCKETS; b++)
+                out->buckets[h][b] += atomic_load_explicit(&slots[i].buckets[h][b], memory_order_relaxed);
+    }
+}
+
+uint64_t metrics_percentile(const uint64_t* buckets, double pct) {
+    uint64_t total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += buckets[b];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(total * pct / 100.0);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) return (uint64_t)2 << b;
+    }
+    return (uint64_t)2 << (METRICS_BUCKETS - 1);
+}
+
+// Appends the totals as one JSON object, with per-second rates since the previous line
+static void write_stats(metrics_totals_t* prev, uint64_t* prev_ns) {
+    metrics_totals_t now;
+    metrics_collect(&now);
+    uint64_t t = now_ns();
+    double elapsed = (t - *prev_ns) / 1e9;
+
+    fprintf(stats_file, "{\"t\":%.3f,\"counters\":{", (t - stats_epoch_ns) / 1e9);
+    for (int c = 0; c < METRIC_N_COUNTERS; c++)
+        fprintf(stats_file, "%s\"%s\":%llu", c ? "," : "", counter_names[c], (unsigned long long)now.counters[c]);
+
+    fprintf(stats_file, "},\"rates\":{");
+    for (int c = 0; c < METRIC_N_COUNTERS; c++)
+        fprintf(stats_file, "%s\"%s\":%.1f", c ? "," : "", counter_names[c],
+                elapsed > 0 ? (now.counters[c] - prev->counters[c]) / elapsed : 0.0);
+
+    fprintf(stats_file, "},\"histograms\":{");
+    for (int h = 0; h < METRIC_N_HISTOGRAMS; h++) {
+        uint64_t count = 0;
+        for (int b = 0; b < METRICS_BUCKETS; b++) count += now.buckets[h][b];
+        fprintf(stats_file, "%s\"%s\":{\"count\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"buckets\":[",
+                h ? "," : "", hist_names[h], (unsigned long long)count,
+                (unsigned long long)metrics_percentile(now.buckets[h], 50),
+                (unsigned long long)metrics_percentile(now.buckets[h], 90),
+                (unsigned long long)metrics_percentile(now.buckets[h], 99));
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+            fprintf(stats_file, "%s%llu", b ? "," : "", (unsigned long long)now.buckets[h][b]);
+        fprintf(stats_file, "]}");
+    }
+    fprintf(stats_file, "}}\n");
+    fflush(stats_file);
+
+    *prev = now;
+    *prev_ns = t;
+}
+
+static void* dumper_task(void* arg) {
+    (void)arg;
+    metrics_totals_t prev;
+    metrics_collect(&prev);
+    uint64_t prev_ns = now_ns();
+
+    pthread_mutex_lock(&dumper_mutex);
+    while (!dumper_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += METRICS_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (METRICS_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&dumper_cond, &dumper_mutex, &deadline) == 0 && dumper_stop) break;
+
+        pthread_mutex_unlock(&dumper_mutex);
+        write_stats(&prev, &prev_ns);
+        pthread_mutex_lock(&dumper_mutex);
+    }
+    pthread_mutex_unlock(&dumper_mutex);
+
+    // Final totals, so short runs still leave a line behind
+    write_stats(&prev, &prev_ns);
+    return NULL;
+}
+
+int metrics_start(const char* path) {
+    stats_file = fopen(path, "w");
+    if (!stats_file) return -1;
+
+    stats_epoch_ns = now_ns();
+    dumper_stop = 0;
+    if (pthread_create(&dumper_tid, NULL, dumper_task, NULL) != 0) {
+        fclose(stats_file);
+        stats_file = NULL;
+        return -1;
+    }
+    metrics_enable(1);
+    return 0;
+}
+
+void metrics_stop() {
+    if (!stats_file) return;
+    pthread_mutex_lock(&dumper_mutex);
+    dumper_stop = 1;
+    pthread_cond_signal(&dumper_cond);
+    pthread_mutex_unlock(&dumper_mutex);
+    pthread_join(dumper_tid, NULL);
+    fclose(stats_file);
+    stats_file = NULL;
+}
+
+void metrics_summary(char* buf, size_t len) {
+    // Rates cover the last full second, the overlay may be redrawn many times within one
+    static metrics_totals_t prev;
+    static uint64_t prev_ns;
+    static double moves_rate;
+    metrics_totals_t now;
+    metrics_collect(&now);
+    uint64_t t = now_ns();
+
+    uint64_t moves = now.counters[METRIC_PACMAN_MOVES] + now.counters[METRIC_GHOST_MOVES];
+    if (prev_ns == 0 || t - prev_ns >= 1000000000ull) {
+        if (prev_ns != 0) {
+            uint64_t prev_moves = prev.counters[METRIC_PACMAN_MOVES] + prev.counters[METRIC_GHOST_MOVES];
+            moves_rate = (moves - prev_moves) / ((t - prev_ns) / 1e9);
+        }
+        prev = now;
+        prev_ns = t;
+    }
+
+    snprintf(buf, len, "moves/s %.0f | invalid %.1f%% | deaths %llu | overruns %llu | "
+             "move p99 %.1f us | lock hold p99 %.1f us",
+             moves_rate,
+             moves ? 100.0 * now.counters[METRIC_INVALID_MOVES] / moves : 0.0,
+             (unsigned long long)now.counters[METRIC_DEATHS],
+             (unsigned long long)now.counters[METRIC_TICK_OVERRUNS],
+             metrics_percentile(now.buckets[METRIC_HIST_MOVE_NS], 99) / 1e3,
+             metrics_percentile(now.buckets[METRIC_HIST_LOCK_HOLD_NS], 99) / 1e3);
+}
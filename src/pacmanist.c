@@ -0,0 +1,86 @@
+#include "pacmanist.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct pacmanist {
+    board_t board;
+};
+
+pacmanist_t* pacmanist_create(const char* level_path, int points) {
+    pacmanist_t* game = calloc(1, sizeof(pacmanist_t));
+    if (!game) return NULL;
+    if (load_level_file(&game->board, level_path, 0, points) < 0) {
+        unload_level(&game->board);
+        free(game);
+        return NULL;
+    }
+    game_start(&game->board);
+    return game;
+}
+
+long pacmanist_step(pacmanist_t* game, long ticks) {
+    board_t* board = &game->board;
+    long done = 0;
+    while (done < ticks && game_is_running(board)) {
+        char keys[MAX_PACMANS] = { 0 };
+        input_cmd_t input;
+        for (int i = 0; i < board->n_pacmans && i < MAX_PACMANS; i++) {
+            if (input_queue_pop(&board->pacmans[i].input, &input)) keys[i] = input.command;
+        }
+        board_tick_keys(board, keys);
+        done++;
+    }
+    return done;
+}
+
+int pacmanist_input(pacmanist_t* game, char key) {
+    return pacmanist_input_pacman(game, 0, key);
+}
+
+int pacmanist_input_pacman(pacmanist_t* game, int pacman, char key) {
+    if (pacman < 0 || pacman >= game->board.n_pacmans) return -1;
+    return input_queue_push(&game->board.pacmans[pacman].input, key);
+}
+
+void pacmanist_resume(pacmanist_t* game) {
+    game_start(&game->board);
+}
+
+void pacmanist_info(pacmanist_t* game, pacmanist_info_t* info) {
+    board_t* board = &game->board;
+    memset(info, 0, sizeof(pacmanist_info_t));
+    info->width = board->width;
+    info->height = board->height;
+    info->tick = atomic_load(&board->tick);
+    info->state = game_state(board);
+    info->dots_left = count_dots(board);
+    info->n_ghosts = board->n_ghosts;
+    info->n_pacmans = board->n_pacmans;
+    if (board->n_pacmans > 0) {
+        info->pacman_x = board->pacmans[0].pos_x;
+        info->pacman_y = board->pacmans[0].pos_y;
+        info->pacman_alive = atomic_load(&board->pacmans[0].alive);
+        info->points = board->pacmans[0].points;
+    }
+}
+
+char pacmanist_cell(pacmanist_t* game, int x, int y) {
+    board_t* board = &game->board;
+    if (x < 0 || y < 0 || x >= board->width || y >= board->height) return '\0';
+    int index = y * board->width + x;
+    char c = board->cells[index];
+    if (c != ' ') return c;
+    if (board_has_portal(board, index)) return '@';
+    if (board_has_dot(board, index)) return '.';
+    return c;
+}
+
+board_t* pacmanist_board(pacmanist_t* game) {
+    return &game->board;
+}
+
+void pacmanist_destroy(pacmanist_t* game) {
+    if (!game) return;
+    unload_level(&game->board);
+    free(game);
+}
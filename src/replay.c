@@ -0,0 +1,241 @@
+#include "replay.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void write_event(recorder_t* rec, uint32_t tick, rec_kind_t kind, uint8_t arg, const void* payload, uint16_t len) {
+    if (!rec->f) return;
+    rec_event_t ev = { .tick = tick, .kind = kind, .arg = arg, .len = len };
+    pthread_mutex_lock(&rec->lock);
+    fwrite(&ev, sizeof(rec_event_t), 1, rec->f);
+    if (len > 0) fwrite(payload, 1, len, rec->f);
+    rec->events++;
+    pthread_mutex_unlock(&rec->lock);
+}
+
+int recorder_open(recorder_t* rec, const char* path, uint64_t seed, long rewind_kb) {
+    memset(rec, 0, sizeof(recorder_t));
+    rec->f = fopen(path, "wb");
+    if (!rec->f) return -1;
+    pthread_mutex_init(&rec->lock, NULL);
+    int64_t kb = rewind_kb;
+    fwrite(REPLAY_MAGIC, 1, sizeof(REPLAY_MAGIC), rec->f);
+    fwrite(&seed, sizeof(seed), 1, rec->f);
+    fwrite(&kb, sizeof(kb), 1, rec->f);
+    return 0;
+}
+
+void recorder_level(recorder_t* rec, const char* level_path) {
+    write_event(rec, 0, REC_LEVEL, 0, level_path, (uint16_t)strlen(level_path));
+}
+
+void recorder_key(recorder_t* rec, uint32_t tick, int pacman, char key) {
+    uint8_t index = (uint8_t)pacman;
+    write_event(rec, tick, REC_KEY, (uint8_t)key, &index, pacman > 0 ? 1 : 0);
+}
+
+unsigned recorder_tick(recorder_t* rec, board_t* board, input_cmd_t* inputs) {
+    char keys[MAX_PACMANS] = { 0 };
+    unsigned popped = 0;
+    uint32_t tick = atomic_load(&board->tick);
+    for (int i = 0; i < board->n_pacmans && i < MAX_PACMANS; i++) {
+        pacman_t* pac = &board->pacmans[i];
+        if (pac->n_moves > 0 || !atomic_load(&pac->alive) || !input_queue_pop(&pac->input, &inputs[i])) continue;
+        keys[i] = inputs[i].command;
+        popped |= 1u << i;
+        recorder_key(rec, tick, i, keys[i]);
+    }
+    board_tick_keys(board, keys);
+    return popped;
+}
+
+void recorder_end(recorder_t* rec, board_t* board, game_state_t state) {
+    uint64_t digest = board_digest(board);
+    write_event(rec, atomic_load(&board->tick), REC_END, (uint8_t)state, &digest, sizeof(digest));
+}
+
+void recorder_action(recorder_t* rec, board_t* board, rec_kind_t kind) {
+    write_event(rec, atomic_load(&board->tick), kind, 0, NULL, 0);
+}
+
+void recorder_close(recorder_t* rec) {
+    if (!rec->f) return;
+    fclose(rec->f);
+    rec->f = NULL;
+    pthread_mutex_destroy(&rec->lock);
+}
+
+static uint64_t fnv(uint64_t h, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t board_digest(board_t* board) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t cells = (size_t)board->width * board->height;
+    h = fnv(h, board->cells, cells);
+    h = fnv(h, board->dots, (cells + 63) / 64 * sizeof(uint64_t));
+    for (int i = 0; i < board->n_pacmans; i++) {
+        pacman_t* pac = &board->pacmans[i];
+        int state[4] = { pac->pos_x, pac->pos_y, pac->points, atomic_load(&pac->alive) };
+        h = fnv(h, state, sizeof(state));
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        int state[3] = { ghost->pos_x, ghost->pos_y, ghost->charged };
+        h = fnv(h, state, sizeof(state));
+    }
+    return h;
+}
+
+// Runs ticks without input until the board reaches 'tick' or the round ends
+static long advance_to(board_t* board, uint32_t tick) {
+    long ticks = 0;
+    while (game_is_running(board) && atomic_load(&board->tick) < tick) {
+        board_tick(board, '\0');
+        ticks++;
+    }
+    return ticks;
+}
+
+// Keys recorded for the same tick, one per pacman, fed to a single board_tick_keys
+typedef struct {
+    char keys[MAX_PACMANS];
+    uint32_t tick;
+    int count;
+} pending_keys_t;
+
+// Plays the pending keys at their tick, dropping them if the board already went past it
+static void flush_keys(board_t* board, pending_keys_t* pending, replay_result_t* result) {
+    if (pending->count == 0) return;
+    result->ticks += advance_to(board, pending->tick);
+    if (game_is_running(board) && atomic_load(&board->tick) == pending->tick) {
+        board_tick_keys(board, pending->keys);
+        result->ticks++;
+        result->keys += pending->count;
+    }
+    memset(pending, 0, sizeof(pending_keys_t));
+}
+
+// Pacman points carried into the next level, each pacman keeping its own
+static void carry_points(board_t* board, const int* points) {
+    for (int i = 0; i < board->n_pacmans && i < MAX_PACMANS; i++) board->pacmans[i].points = points[i];
+}
+
+int replay_run(const char* path, replay_result_t* result) {
+    memset(result, 0, sizeof(replay_result_t));
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+
+    char magic[sizeof(REPLAY_MAGIC)];
+    uint64_t seed;
+    int64_t rewind_kb;
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+        fread(&seed, sizeof(seed), 1, f) != 1 || fread(&rewind_kb, sizeof(rewind_kb), 1, f) != 1) {
+        fclose(f);
+        return -1;
+    }
+    board_t board;
+    memset(&board, 0, sizeof(board_t));
+    board.seed = seed;
+    int loaded = 0;
+    board_snapshot_t saves[MAX_SNAPSHOTS];
+    memset(saves, 0, sizeof(saves));
+    int n_saves = 0;
+    rewind_buffer_t rewind;
+    int rewinding = rewind_kb >= 0 && rewind_init(&rewind, (size_t)rewind_kb) == 0;
+
+    rec_event_t ev;
+    char payload[UINT16_MAX + 1];
+    pending_keys_t pending;
+    memset(&pending, 0, sizeof(pending));
+    int points[MAX_PACMANS] = { 0 };
+    int malformed = 0;
+    while (!malformed && fread(&ev, sizeof(rec_event_t), 1, f) == 1) {
+        if (ev.len > 0 && fread(payload, 1, ev.len, f) != ev.len) break;
+        payload[ev.len] = '\0';
+        if (loaded && (ev.kind != REC_KEY || ev.tick != pending.tick)) {
+            flush_keys(&board, &pending, result);
+        }
+
+        switch (ev.kind) {
+            case REC_LEVEL: {
+                if (loaded) {
+                    for (int i = 0; i < board.n_pacmans && i < MAX_PACMANS; i++) points[i] = board.pacmans[i].points;
+                    unload_level(&board);
+                }
+                load_level_file(&board, payload, 0, 0);
+                carry_points(&board, points);
+                if (rewinding) {
+                    if (!loaded) add_delta_hook(&board, rewind_hook, &rewind);
+                    rewind_clear(&rewind, &board);
+                }
+                loaded = 1;
+                n_saves = 0;
+                result->levels++;
+                game_start(&board);
+                break;
+            }
+            case REC_KEY: {
+                int pacman = ev.len >= 1 ? (uint8_t)payload[0] : 0;
+                if (!loaded || pacman >= MAX_PACMANS) break;
+                // recorder_tick records at most one key per pacman per tick
+                if (pending.keys[pacman] != '\0') {
+                    malformed = 1;
+                    break;
+                }
+                pending.tick = ev.tick;
+                pending.keys[pacman] = (char)ev.arg;
+                pending.count++;
+                break;
+            }
+            case REC_END: {
+                if (!loaded) break;
+                result->ticks += advance_to(&board, ev.tick);
+                uint64_t digest;
+                memcpy(&digest, payload, sizeof(digest));
+                if (ev.len != sizeof(digest) || board_digest(&board) != digest) {
+                    if (result->mismatches++ == 0) result->first_mismatch_tick = ev.tick;
+                }
+                result->rounds++;
+                game_start(&board);
+                break;
+            }
+            case REC_SAVE:
+                if (!loaded) break;
+                if (n_saves == MAX_SNAPSHOTS) {
+                    board_snapshot_t oldest = saves[0];
+                    memmove(&saves[0], &saves[1], (MAX_SNAPSHOTS - 1) * sizeof(board_snapshot_t));
+                    saves[MAX_SNAPSHOTS - 1] = oldest;
+                    n_saves--;
+                }
+                if (snapshot_save(&saves[n_saves], &board) == 0) n_saves++;
+                break;
+            case REC_RESTORE:
+                if (!loaded || n_saves == 0) break;
+                snapshot_restore(&saves[--n_saves], &board);
+                if (rewinding) rewind_clear(&rewind, &board);
+                break;
+            case REC_REWIND:
+                if (loaded && rewinding) rewind_ticks(&rewind, &board, REWIND_TICKS);
+                break;
+        }
+    }
+    fclose(f);
+
+    if (loaded) {
+        flush_keys(&board, &pending, result);
+        result->digest = board_digest(&board);
+        unload_level(&board);
+    }
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        snapshot_free(&saves[i]);
+    }
+    if (rewinding) rewind_free(&rewind);
+    return malformed ? -1 : 0;
+}
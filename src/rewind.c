@@ -0,0 +1,125 @@
+#include "rewind.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Record layout: kind, tick, index, undo payload, then the record length so the ring can be
+// walked backwards from its newest end
+#define RECORD_HEADER (sizeof(uint8_t) + sizeof(uint32_t) + sizeof(int32_t))
+#define MAX_RECORD (RECORD_HEADER + sizeof(agent_state_t) + 1)
+
+static size_t record_size(uint8_t kind) {
+    switch (kind) {
+        case DELTA_CELL: return RECORD_HEADER + 1 + 1;
+        case DELTA_DOT: return RECORD_HEADER + 1;
+        default: return RECORD_HEADER + sizeof(agent_state_t) + 1;
+    }
+}
+
+// Helper private functions for copying in and out of the ring, in two pieces across the wrap point
+static void ring_write(rewind_buffer_t* rb, size_t pos, const unsigned char* src, size_t len) {
+    size_t off = pos % rb->capacity;
+    size_t first = len < rb->capacity - off ? len : rb->capacity - off;
+    memcpy(rb->ring + off, src, first);
+    memcpy(rb->ring, src + first, len - first);
+}
+
+static void ring_read(rewind_buffer_t* rb, size_t pos, unsigned char* dst, size_t len) {
+    size_t off = pos % rb->capacity;
+    size_t first = len < rb->capacity - off ? len : rb->capacity - off;
+    memcpy(dst, rb->ring + off, first);
+    memcpy(dst + first, rb->ring, len - first);
+}
+
+int rewind_init(rewind_buffer_t* rb, size_t kilobytes) {
+    memset(rb, 0, sizeof(rewind_buffer_t));
+    rb->capacity = (kilobytes > 0 ? kilobytes : DEFAULT_REWIND_KB) * 1024;
+    rb->ring = malloc(rb->capacity);
+    if (!rb->ring) return -1;
+    pthread_mutex_init(&rb->mutex, NULL);
+    return 0;
+}
+
+void rewind_hook(void* ctx, const board_delta_t* delta) {
+    rewind_buffer_t* rb = (rewind_buffer_t*)ctx;
+    unsigned char record[MAX_RECORD];
+    size_t size = record_size(delta->kind);
+
+    unsigned char* p = record;
+    *p++ = delta->kind;
+    memcpy(p, &delta->tick, sizeof(uint32_t)); p += sizeof(uint32_t);
+    memcpy(p, &delta->index, sizeof(int32_t)); p += sizeof(int32_t);
+    if (delta->kind == DELTA_CELL) {
+        *p++ = (unsigned char)delta->old_cell;
+    } else if (delta->kind == DELTA_PACMAN || delta->kind == DELTA_GHOST) {
+        memcpy(p, &delta->before, sizeof(agent_state_t));
+        p += sizeof(agent_state_t);
+    }
+    *p = (unsigned char)size;
+
+    // Only the room and the copy are done under the lock, the record is already encoded
+    pthread_mutex_lock(&rb->mutex);
+    // Make room by dropping the oldest records
+    while (rb->used + size > rb->capacity) {
+        unsigned char oldest[sizeof(uint8_t) + sizeof(uint32_t)];
+        ring_read(rb, rb->start, oldest, sizeof(oldest));
+        uint32_t oldest_tick;
+        memcpy(&oldest_tick, oldest + 1, sizeof(uint32_t));
+        // The tick of a dropped record can no longer be undone completely
+        if (oldest_tick + 1 > rb->horizon) rb->horizon = oldest_tick + 1;
+
+        size_t oldest_size = record_size(oldest[0]);
+        rb->start = (rb->start + oldest_size) % rb->capacity;
+        rb->used -= oldest_size;
+    }
+    ring_write(rb, rb->start + rb->used, record, size);
+    rb->used += size;
+    pthread_mutex_unlock(&rb->mutex);
+}
+
+unsigned rewind_ticks(rewind_buffer_t* rb, board_t* board, unsigned ticks) {
+    unsigned now = atomic_load(&board->tick);
+    unsigned target = ticks < now ? now - ticks : 0;
+
+    pthread_mutex_lock(&rb->mutex);
+    if (target < rb->horizon) target = rb->horizon < now ? rb->horizon : now;
+
+    while (rb->used > 0) {
+        unsigned char record[MAX_RECORD];
+        size_t size = rb->ring[(rb->start + rb->used - 1) % rb->capacity];
+        ring_read(rb, rb->start + rb->used - size, record, size);
+
+        board_delta_t delta;
+        memset(&delta, 0, sizeof(delta));
+        delta.kind = record[0];
+        memcpy(&delta.tick, record + 1, sizeof(uint32_t));
+        memcpy(&delta.index, record + 1 + sizeof(uint32_t), sizeof(int32_t));
+        if (delta.tick < target) break;
+
+        if (delta.kind == DELTA_CELL) {
+            delta.old_cell = (char)record[RECORD_HEADER];
+        } else if (delta.kind == DELTA_PACMAN || delta.kind == DELTA_GHOST) {
+            memcpy(&delta.before, record + RECORD_HEADER, sizeof(agent_state_t));
+        }
+        apply_delta(board, &delta, 1);
+        rb->used -= size;
+    }
+    pthread_mutex_unlock(&rb->mutex);
+
+    atomic_store(&board->tick, target);
+    return now - target;
+}
+
+void rewind_clear(rewind_buffer_t* rb, board_t* board) {
+    pthread_mutex_lock(&rb->mutex);
+    rb->start = 0;
+    rb->used = 0;
+    rb->horizon = atomic_load(&board->tick);
+    pthread_mutex_unlock(&rb->mutex);
+}
+
+void rewind_free(rewind_buffer_t* rb) {
+    if (!rb->ring) return;
+    pthread_mutex_destroy(&rb->mutex);
+    free(rb->ring);
+    memset(rb, 0, sizeof(rewind_buffer_t));
+}
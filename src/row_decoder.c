@@ -0,0 +1,98 @@
+#include "row_decoder.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+// ORs the bits of 'mask' into the bitset starting at bit 'bit' (may straddle two words)
+static inline void or_bits(uint64_t* set, int bit, uint64_t mask) {
+    if (mask == 0) return;
+    int word = bit >> 6;
+    int shift = bit & 63;
+    set[word] |= mask << shift;
+    if (shift != 0 && (mask >> (64 - shift)) != 0) {
+        set[word + 1] |= mask >> (64 - shift);
+    }
+}
+
+void decode_row_scalar(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len) {
+    for (int col = 0; col < len; col++) {
+        int index = first + col;
+        char c = row[col];
+
+        if (c == 'X') {
+            cells[index] = 'W';
+        } else if (c == '@') {
+            cells[index] = ' ';
+            portals[index >> 6] |= UINT64_C(1) << (index & 63);
+        } else if (c == 'o') {
+            cells[index] = ' ';
+            dots[index >> 6] |= UINT64_C(1) << (index & 63);
+        } else {
+            cells[index] = ' ';
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// Decodes 16 characters per step, returns how many were handled
+static int decode_row_sse2(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len) {
+    const __m128i wall_in = _mm_set1_epi8('X');
+    const __m128i dot_in = _mm_set1_epi8('o');
+    const __m128i portal_in = _mm_set1_epi8('@');
+    const __m128i wall_out = _mm_set1_epi8('W');
+    const __m128i empty_out = _mm_set1_epi8(' ');
+
+    int col = 0;
+    for (; col + 16 <= len; col += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + col));
+        __m128i is_wall = _mm_cmpeq_epi8(v, wall_in);
+
+        // 'W' where there is a wall, ' ' everywhere else
+        __m128i out = _mm_or_si128(_mm_and_si128(is_wall, wall_out), _mm_andnot_si128(is_wall, empty_out));
+        _mm_storeu_si128((__m128i*)(cells + first + col), out);
+
+        or_bits(dots, first + col, (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dot_in)));
+        or_bits(portals, first + col, (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, portal_in)));
+    }
+    return col;
+}
+
+// Same as decode_row_sse2 with 32 characters per step
+__attribute__((target("avx2")))
+static int decode_row_avx2(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len) {
+    const __m256i wall_in = _mm256_set1_epi8('X');
+    const __m256i dot_in = _mm256_set1_epi8('o');
+    const __m256i portal_in = _mm256_set1_epi8('@');
+    const __m256i wall_out = _mm256_set1_epi8('W');
+    const __m256i empty_out = _mm256_set1_epi8(' ');
+
+    int col = 0;
+    for (; col + 32 <= len; col += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + col));
+        __m256i is_wall = _mm256_cmpeq_epi8(v, wall_in);
+
+        __m256i out = _mm256_blendv_epi8(empty_out, wall_out, is_wall);
+        _mm256_storeu_si256((__m256i*)(cells + first + col), out);
+
+        or_bits(dots, first + col, (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dot_in)));
+        or_bits(portals, first + col, (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, portal_in)));
+    }
+    return col;
+}
+#endif
+
+void decode_row(char* cells, uint64_t* dots, uint64_t* portals, int first, const char* row, int len) {
+    int col = 0;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        col = decode_row_avx2(cells, dots, portals, first, row, len);
+    } else {
+        col = decode_row_sse2(cells, dots, portals, first, row, len);
+    }
+#endif
+
+    decode_row_scalar(cells, dots, portals, first + col, row + col, len - col);
+}
@@ -0,0 +1,192 @@
+#include "server.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+struct server {
+    int n_workers;
+    int budget;
+    session_t* sessions;
+    int n_sessions, cap_sessions;
+
+    // run queue: a ring of session indexes, guarded by 'mutex'
+    int* queue;
+    int head, count;
+    int active;             // sessions not finished yet
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+
+    uint64_t started_ns, finished_ns;
+};
+
+server_t* server_create(int workers, int budget) {
+    server_t* server = calloc(1, sizeof(server_t));
+    if (!server) return NULL;
+    server->n_workers = workers > 0 ? workers : 1;
+    server->budget = budget > 0 ? budget : SERVER_DEFAULT_BUDGET;
+    pthread_mutex_init(&server->mutex, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    return server;
+}
+
+int server_add(server_t* server, pacmanist_t* game, long ticks, session_policy_t policy, void* ctx) {
+    if (server->n_sessions == server->cap_sessions) {
+        int cap = server->cap_sessions ? server->cap_sessions * 2 : 64;
+        session_t* sessions = realloc(server->sessions, cap * sizeof(session_t));
+        if (!sessions) return -1;
+        server->sessions = sessions;
+        server->cap_sessions = cap;
+    }
+    session_t* s = &server->sessions[server->n_sessions++];
+    memset(s, 0, sizeof(session_t));
+    s->game = game;
+    s->policy = policy;
+    s->ctx = ctx;
+    s->ticks_target = ticks;
+    return 0;
+}
+
+session_t* server_session(server_t* server, int i) {
+    return &server->sessions[i];
+}
+
+// Adds the wall time since the session's previous tick to its histogram
+static void record_tick(session_t* s, uint64_t now) {
+    uint64_t ns = now - s->last_tick_ns;
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (b >= METRICS_BUCKETS) b = METRICS_BUCKETS - 1;
+    s->tick_buckets[b]++;
+    if (ns > s->max_tick_ns) s->max_tick_ns = ns;
+    s->last_tick_ns = now;
+}
+
+// Runs one quantum of 'session', returns 1 when the session is done
+static int run_quantum(server_t* server, session_t* s) {
+    board_t* board = pacmanist_board(s->game);
+    uint64_t start = now_ns();
+    for (int i = 0; i < server->budget && s->ticks < s->ticks_target; i++) {
+        if (s->policy) {
+            char key = s->policy(s->game, s->ctx);
+            if (key != '\0') pacmanist_input(s->game, key);
+        }
+        if (pacmanist_step(s->game, 1) == 0) break;
+        s->ticks++;
+        record_tick(s, now_ns());
+    }
+    uint64_t end = now_ns();
+    s->service_ns += end - start;
+    if (s->ticks >= s->ticks_target || !game_is_running(board)) {
+        s->finished_ns = end;
+        return 1;
+    }
+    s->ready_ns = end;
+    return 0;
+}
+
+static void* worker_task(void* arg) {
+    server_t* server = (server_t*)arg;
+    pthread_mutex_lock(&server->mutex);
+    while (1) {
+        while (server->count == 0 && server->active > 0) {
+            pthread_cond_wait(&server->ready, &server->mutex);
+        }
+        if (server->active == 0) break;
+
+        int index = server->queue[server->head];
+        server->head = (server->head + 1) % server->n_sessions;
+        server->count--;
+        pthread_mutex_unlock(&server->mutex);
+
+        session_t* s = &server->sessions[index];
+        uint64_t waited = now_ns() - s->ready_ns;
+        if (waited > s->max_wait_ns) s->max_wait_ns = waited;
+        int done = run_quantum(server, s);
+
+        pthread_mutex_lock(&server->mutex);
+        if (done) {
+            if (--server->active == 0) pthread_cond_broadcast(&server->ready);
+        } else {
+            server->queue[(server->head + server->count) % server->n_sessions] = index;
+            server->count++;
+            pthread_cond_signal(&server->ready);
+        }
+    }
+    pthread_mutex_unlock(&server->mutex);
+    return NULL;
+}
+
+void server_run(server_t* server) {
+    if (server->n_sessions == 0) return;
+    server->queue = malloc(server->n_sessions * sizeof(int));
+    pthread_t* tids = malloc(server->n_workers * sizeof(pthread_t));
+    if (!server->queue || !tids) {
+        free(tids);
+        return;
+    }
+
+    server->started_ns = now_ns();
+    for (int i = 0; i < server->n_sessions; i++) {
+        server->queue[i] = i;
+        server->sessions[i].started_ns = server->started_ns;
+        server->sessions[i].ready_ns = server->started_ns;
+        server->sessions[i].last_tick_ns = server->started_ns;
+    }
+    server->head = 0;
+    server->count = server->n_sessions;
+    server->active = server->n_sessions;
+
+    for (int i = 0; i < server->n_workers; i++) {
+        pthread_create(&tids[i], NULL, worker_task, server);
+    }
+    for (int i = 0; i < server->n_workers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    server->finished_ns = now_ns();
+    free(tids);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts 'values' and picks the percentiles
+static void percentiles(uint64_t* values, int n, uint64_t* p50, uint64_t* p99, uint64_t* max) {
+    qsort(values, n, sizeof(uint64_t), compare_u64);
+    *p50 = values[n / 2];
+    *p99 = values[(n - 1) * 99 / 100];
+    *max = values[n - 1];
+}
+
+void server_stats(server_t* server, server_stats_t* stats) {
+    memset(stats, 0, sizeof(server_stats_t));
+    stats->sessions = server->n_sessions;
+    stats->workers = server->n_workers;
+    if (server->n_sessions == 0) return;
+
+    uint64_t* wait_ns = malloc(server->n_sessions * sizeof(uint64_t));
+    if (!wait_ns) return;
+    uint64_t tick_buckets[METRICS_BUCKETS] = { 0 };
+    for (int i = 0; i < server->n_sessions; i++) {
+        session_t* s = &server->sessions[i];
+        stats->ticks += s->ticks;
+        for (int b = 0; b < METRICS_BUCKETS; b++) tick_buckets[b] += s->tick_buckets[b];
+        if (s->max_tick_ns > stats->tick_ns_max) stats->tick_ns_max = s->max_tick_ns;
+        wait_ns[i] = s->max_wait_ns;
+    }
+    stats->seconds = (server->finished_ns - server->started_ns) / 1e9;
+    stats->ticks_per_second = stats->seconds > 0 ? stats->ticks / stats->seconds : 0;
+    stats->tick_ns_p50 = metrics_percentile(tick_buckets, 50);
+    stats->tick_ns_p99 = metrics_percentile(tick_buckets, 99);
+    percentiles(wait_ns, server->n_sessions, &stats->wait_ns_p50, &stats->wait_ns_p99, &stats->wait_ns_max);
+    free(wait_ns);
+}
+
+void server_destroy(server_t* server) {
+    if (!server) return;
+    pthread_mutex_destroy(&server->mutex);
+    pthread_cond_destroy(&server->ready);
+    free(server->queue);
+    free(server->sessions);
+    free(server);
+}
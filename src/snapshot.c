@@ -0,0 +1,68 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Sizes of the snapshot buffers for a width x height board
+static size_t cells_size(int width, int height) { return (size_t)width * height; }
+static size_t dots_size(int width, int height) { return ((size_t)width * height + 63) / 64 * sizeof(uint64_t); }
+
+// Helper private function for checking if the snapshot buffers fit the board as it is now
+static int fits(board_snapshot_t* snap, board_t* board) {
+    return snap->cells != NULL && snap->width == board->width && snap->height == board->height &&
+           snap->n_pacmans == board->n_pacmans && snap->n_ghosts == board->n_ghosts;
+}
+
+int snapshot_save(board_snapshot_t* snap, board_t* board) {
+    if (!fits(snap, board)) {
+        snapshot_free(snap);
+        snap->cells = malloc(cells_size(board->width, board->height));
+        snap->dots = malloc(dots_size(board->width, board->height));
+        snap->pacmans = calloc(board->n_pacmans > 0 ? board->n_pacmans : 1, sizeof(pacman_t));
+        snap->ghosts = calloc(board->n_ghosts > 0 ? board->n_ghosts : 1, sizeof(ghost_t));
+        if (!snap->cells || !snap->dots || !snap->pacmans || !snap->ghosts) {
+            snapshot_free(snap);
+            return -1;
+        }
+        snap->width = board->width;
+        snap->height = board->height;
+        snap->n_pacmans = board->n_pacmans;
+        snap->n_ghosts = board->n_ghosts;
+    }
+
+    memcpy(snap->cells, board->cells, cells_size(board->width, board->height));
+    memcpy(snap->dots, board->dots, dots_size(board->width, board->height));
+    snap->dots_left = atomic_load(&board->dots_left);
+    memcpy(snap->pacmans, board->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(snap->ghosts, board->ghosts, board->n_ghosts * sizeof(ghost_t));
+
+    snap->valid = 1;
+    return 0;
+}
+
+int snapshot_restore(board_snapshot_t* snap, board_t* board) {
+    if (!snap->valid || !fits(snap, board)) {
+        return -1;
+    }
+
+    memcpy(board->cells, snap->cells, cells_size(board->width, board->height));
+    memcpy(board->dots, snap->dots, dots_size(board->width, board->height));
+    atomic_store(&board->dots_left, snap->dots_left);
+    memcpy(board->pacmans, snap->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(board->ghosts, snap->ghosts, board->n_ghosts * sizeof(ghost_t));
+
+    // Keys typed before the save (or before dying) must not replay after the restore
+    for (int i = 0; i < board->n_pacmans; i++) {
+        input_queue_init(&board->pacmans[i].input, board->input_depth);
+    }
+
+    atomic_fetch_add(&board->version, 1);
+    return 0;
+}
+
+void snapshot_free(board_snapshot_t* snap) {
+    free(snap->cells);
+    free(snap->dots);
+    free(snap->pacmans);
+    free(snap->ghosts);
+    memset(snap, 0, sizeof(board_snapshot_t));
+}
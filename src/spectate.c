@@ -0,0 +1,254 @@
+#include "spectate.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLOT_ALIGN 64           // slots start on their own cache line
+#define READ_ATTEMPTS 1000      // copies spectate_read tries before giving up until the next call
+
+static size_t header_bytes(void) {
+    return (sizeof(spectate_header_t) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+}
+
+// Bytes of a frame with its planes for a width x height board
+static size_t frame_bytes(int width, int height) {
+    size_t cells = (size_t)width * height;
+    size_t words = (cells + 63) / 64;
+    return sizeof(spectate_frame_t) + (cells + 7) / 8 * 8 + 2 * words * sizeof(uint64_t);
+}
+
+static spectate_frame_t* slot_at(spectate_header_t* header, uint64_t frame, uint64_t slot_size) {
+    return (spectate_frame_t*)((char*)header + header_bytes() + (frame % SPECTATE_SLOTS) * slot_size);
+}
+
+// Shared memory names start with a single '/'
+static void object_name(char* out, size_t size, const char* name) {
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+int spectate_open(spectate_feed_t* feed, const char* name) {
+    memset(feed, 0, sizeof(spectate_feed_t));
+    object_name(feed->name, sizeof(feed->name), name);
+    // A feed left behind by a game that crashed is replaced, not reused: its viewers keep the old one
+    shm_unlink(feed->name);
+    feed->fd = shm_open(feed->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (feed->fd < 0) return -1;
+
+    size_t size = header_bytes();
+    if (ftruncate(feed->fd, size) < 0) goto fail;
+    feed->header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, feed->fd, 0);
+    if (feed->header == MAP_FAILED) goto fail;
+    feed->mapped = size;
+    pthread_mutex_init(&feed->lock, NULL);
+
+    feed->header->magic = SPECTATE_MAGIC;
+    feed->header->version = SPECTATE_VERSION;
+    atomic_init(&feed->header->layout, 0);
+    atomic_init(&feed->header->latest, 0);
+    atomic_init(&feed->header->slot_size, 0);
+    atomic_init(&feed->header->closed, 0);
+    atomic_store_explicit(&feed->header->map_size, size, memory_order_release);
+    return 0;
+
+fail:;
+    int err = errno;
+    close(feed->fd);
+    shm_unlink(feed->name);
+    errno = err;
+    return -1;
+}
+
+// Grows the slots to 'need' bytes. Readers see an odd layout meanwhile and retry
+static int grow_slots(spectate_feed_t* feed, size_t need) {
+    spectate_header_t* header = feed->header;
+    size_t size = header_bytes() + SPECTATE_SLOTS * need;
+    atomic_fetch_add_explicit(&header->layout, 1, memory_order_acq_rel);
+    if (ftruncate(feed->fd, size) < 0) {
+        atomic_fetch_add_explicit(&header->layout, 1, memory_order_release);
+        return -1;
+    }
+    spectate_header_t* bigger = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, feed->fd, 0);
+    if (bigger == MAP_FAILED) {
+        atomic_fetch_add_explicit(&header->layout, 1, memory_order_release);
+        return -1;
+    }
+    munmap(header, feed->mapped);
+    feed->header = header = bigger;
+    feed->mapped = size;
+
+    // The old frames are now at the wrong offsets: no slot holds a complete frame until rewritten
+    for (uint64_t s = 0; s < SPECTATE_SLOTS; s++) {
+        atomic_store_explicit(&slot_at(header, s, need)->seq, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&header->slot_size, need, memory_order_relaxed);
+    atomic_store_explicit(&header->map_size, size, memory_order_release);
+    atomic_fetch_add_explicit(&header->layout, 1, memory_order_release);
+    return 0;
+}
+
+long spectate_publish(spectate_feed_t* feed, board_t* board) {
+    size_t cells = (size_t)board->width * board->height;
+    size_t words = (cells + 63) / 64;
+    size_t need = (frame_bytes(board->width, board->height) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+
+    pthread_mutex_lock(&feed->lock);
+    spectate_header_t* header = feed->header;
+    if (need > atomic_load_explicit(&header->slot_size, memory_order_relaxed) && grow_slots(feed, need) < 0) {
+        pthread_mutex_unlock(&feed->lock);
+        return -1;
+    }
+    header = feed->header;
+    uint64_t frame = feed->frame + 1;
+    spectate_frame_t* slot = slot_at(header, frame, atomic_load_explicit(&header->slot_size, memory_order_relaxed));
+
+    // Seqlock write: the odd value is visible before any of the data changes
+    atomic_store_explicit(&slot->seq, 2 * frame + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->tick = atomic_load(&board->tick);
+    slot->state = atomic_load(&board->state);
+    slot->width = board->width;
+    slot->height = board->height;
+    slot->total_dots = board->total_dots;
+    slot->dots_left = atomic_load(&board->dots_left);
+    slot->n_pacmans = board->n_pacmans < MAX_PACMANS ? board->n_pacmans : MAX_PACMANS;
+    for (int i = 0; i < slot->n_pacmans; i++) {
+        pacman_t* pac = &board->pacmans[i];
+        slot->pacmans[i] = (spectate_pacman_t){ pac->pos_x, pac->pos_y, atomic_load(&pac->alive), pac->points };
+    }
+    snprintf(slot->level_name, sizeof(slot->level_name), "%s", board->level_name);
+    // The agents keep moving meanwhile; like the screen, a frame may catch a move half done
+    memcpy(spectate_cells(slot), board->cells, cells);
+    memcpy(spectate_dots(slot), board->dots, words * sizeof(uint64_t));
+    memcpy(spectate_portals(slot), board->portals, words * sizeof(uint64_t));
+
+    atomic_store_explicit(&slot->seq, 2 * frame + 2, memory_order_release);
+    atomic_store_explicit(&header->latest, frame, memory_order_release);
+    feed->frame = frame;
+    pthread_mutex_unlock(&feed->lock);
+    return (long)frame;
+}
+
+void spectate_close(spectate_feed_t* feed) {
+    if (!feed->header) return;
+    atomic_store_explicit(&feed->header->closed, 1, memory_order_release);
+    munmap(feed->header, feed->mapped);
+    close(feed->fd);
+    shm_unlink(feed->name);
+    pthread_mutex_destroy(&feed->lock);
+    feed->header = NULL;
+}
+
+// Maps 'size' bytes of the feed read-only, replacing the current mapping
+static int map_view(spectate_view_t* view, size_t size) {
+    struct stat st;
+    if (fstat(view->fd, &st) < 0) return -1;
+    if ((size_t)st.st_size < size) size = st.st_size;
+    spectate_header_t* header = mmap(NULL, size, PROT_READ, MAP_SHARED, view->fd, 0);
+    if (header == MAP_FAILED) return -1;
+    if (view->header) munmap(view->header, view->mapped);
+    view->header = header;
+    view->mapped = size;
+    return 0;
+}
+
+int spectate_attach(spectate_view_t* view, const char* name) {
+    memset(view, 0, sizeof(spectate_view_t));
+    char path[64];
+    object_name(path, sizeof(path), name);
+    view->fd = shm_open(path, O_RDONLY, 0);
+    if (view->fd < 0) return -1;
+    if (map_view(view, header_bytes()) < 0 || view->mapped < header_bytes() ||
+        view->header->magic != SPECTATE_MAGIC || view->header->version != SPECTATE_VERSION) {
+        int err = view->header ? EPROTO : errno;
+        spectate_detach(view);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int spectate_read(spectate_view_t* view) {
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        uint64_t map_size = atomic_load_explicit(&view->header->map_size, memory_order_acquire);
+        if (map_size > view->mapped && map_view(view, map_size) < 0) return -1;
+        spectate_header_t* header = view->header;
+
+        uint64_t layout = atomic_load_explicit(&header->layout, memory_order_acquire);
+        uint64_t latest = atomic_load_explicit(&header->latest, memory_order_acquire);
+        if (latest == view->frame) {
+            return atomic_load_explicit(&header->closed, memory_order_acquire) ? -1 : 0;
+        }
+        uint64_t slot_size = atomic_load_explicit(&header->slot_size, memory_order_relaxed);
+        if ((layout & 1) || header_bytes() + SPECTATE_SLOTS * slot_size > view->mapped) {
+            sched_yield();      // the publisher is resizing
+            continue;
+        }
+
+        spectate_frame_t* slot = slot_at(header, latest, slot_size);
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        size_t bytes = frame_bytes(slot->width, slot->height);
+        if (seq != 2 * latest + 2 || slot->width < 0 || slot->height < 0 || bytes > slot_size) {
+            view->retries++;
+            continue;
+        }
+        if (bytes > view->copy_size) {
+            spectate_frame_t* copy = realloc(view->copy, bytes);
+            if (!copy) return 0;
+            view->copy = copy;
+            view->copy_size = bytes;
+        }
+        memcpy(view->copy, slot, bytes);
+
+        // Seqlock read: the copy counts only if the slot and the layout did not change under it
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq ||
+            atomic_load_explicit(&header->layout, memory_order_relaxed) != layout) {
+            view->retries++;
+            continue;
+        }
+        view->frame = latest;
+        return 1;
+    }
+    return 0;
+}
+
+void spectate_detach(spectate_view_t* view) {
+    if (view->header) munmap(view->header, view->mapped);
+    if (view->fd >= 0) close(view->fd);
+    free(view->copy);
+    memset(view, 0, sizeof(spectate_view_t));
+    view->fd = -1;
+}
+
+void spectate_board_view(spectate_view_t* view, board_t* board) {
+    spectate_frame_t* frame = view->copy;
+    memset(board, 0, sizeof(board_t));
+    if (!frame) return;
+    board->width = frame->width;
+    board->height = frame->height;
+    board->cells = spectate_cells(frame);
+    board->dots = spectate_dots(frame);
+    board->portals = spectate_portals(frame);
+    board->total_dots = frame->total_dots;
+    atomic_init(&board->dots_left, frame->dots_left);
+    atomic_init(&board->state, frame->state);
+    atomic_init(&board->tick, frame->tick);
+    snprintf(board->level_name, sizeof(board->level_name), "%s", frame->level_name);
+
+    memset(view->pacmans, 0, sizeof(view->pacmans));
+    board->n_pacmans = frame->n_pacmans;
+    board->pacmans = view->pacmans;
+    for (int i = 0; i < frame->n_pacmans && i < MAX_PACMANS; i++) {
+        view->pacmans[i].pos_x = frame->pacmans[i].x;
+        view->pacmans[i].pos_y = frame->pacmans[i].y;
+        atomic_init(&view->pacmans[i].alive, frame->pacmans[i].alive);
+        view->pacmans[i].points = frame->pacmans[i].points;
+    }
+}
@@ -0,0 +1,143 @@
+#include "spectate.h"
+#include "display.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Viewer of the feed a game publishes with Pacmanist -s: draws it like the game does, or records
+// every frame it sees to a text file. It only reads the shared memory, so the game never waits
+// for it
+
+#define ATTACH_TRIES 50         // the game may not have started yet: try for 10 s
+#define ATTACH_WAIT_MS 200
+#define DEFAULT_REFRESH_MS 16
+
+static void pause_ms(int ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static const char* state_name(int state) {
+    switch (state) {
+        case GAME_RUNNING: return "running";
+        case GAME_PORTAL_REACHED: return "portal";
+        case GAME_PACMAN_DEAD: return "dead";
+        case GAME_QUIT: return "quit";
+        case GAME_BACKUP_REQUESTED: return "quicksave";
+        case GAME_REWIND_REQUESTED: return "rewind";
+        default: return "?";
+    }
+}
+
+// One frame as text: a header line, the scores and the rows ('.' and '@' on empty cells with a
+// dot or a portal, like dump_board)
+static int record_frame(FILE* out, spectate_view_t* view, board_t* board) {
+    fprintf(out, "FRAME %llu TICK %u STATE %s LEVEL %s\nPOINTS", (unsigned long long)view->frame,
+            atomic_load(&board->tick), state_name(atomic_load(&board->state)), board->level_name);
+    for (int i = 0; i < board->n_pacmans; i++) {
+        fprintf(out, " %d%s", board->pacmans[i].points, atomic_load(&board->pacmans[i].alive) ? "" : "x");
+    }
+    fprintf(out, " DOTS %d/%d\n", count_dots(board), board->total_dots);
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            int index = y * board->width + x;
+            char c = board->cells[index];
+            if (c == ' ' && board_has_portal(board, index)) c = '@';
+            else if (c == ' ' && board_has_dot(board, index)) c = '.';
+            putc(c, out);
+        }
+        putc('\n', out);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [-o record_file] [-n frames] [-r refresh_ms] [feed]\n", prog);
+    printf("  -o record_file  write every frame seen to this file instead of drawing it\n");
+    printf("  -n frames       stop after this many frames\n");
+    printf("  -r refresh_ms   how often the feed is checked for a new frame (default %d)\n", DEFAULT_REFRESH_MS);
+    printf("  feed            name given to Pacmanist -s (default %s)\n", SPECTATE_DEFAULT_NAME);
+}
+
+int main(int argc, char** argv) {
+    const char* record_path = NULL;
+    long max_frames = -1;
+    int refresh_ms = DEFAULT_REFRESH_MS;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:n:r:")) != -1) {
+        switch (opt) {
+            case 'o':
+                record_path = optarg;
+                break;
+            case 'n':
+                max_frames = atol(optarg);
+                break;
+            case 'r':
+                refresh_ms = atoi(optarg);
+                if (refresh_ms < 1) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* name = optind < argc ? argv[optind] : SPECTATE_DEFAULT_NAME;
+
+    spectate_view_t view;
+    int attached = -1;
+    for (int i = 0; i < ATTACH_TRIES && (attached = spectate_attach(&view, name)) < 0 && errno == ENOENT; i++) {
+        if (i == 0) fprintf(stderr, "Waiting for the feed %s...\n", name);
+        pause_ms(ATTACH_WAIT_MS);
+    }
+    if (attached < 0) {
+        perror("Failed to open the feed");
+        return EXIT_FAILURE;
+    }
+
+    FILE* record = NULL;
+    if (record_path) {
+        record = fopen(record_path, "w");
+        if (!record) {
+            perror("Failed to create record file");
+            spectate_detach(&view);
+            return EXIT_FAILURE;
+        }
+    } else {
+        terminal_init();
+    }
+
+    long frames = 0;
+    board_t board;
+    while (max_frames < 0 || frames < max_frames) {
+        int got = spectate_read(&view);
+        if (got < 0) break;     // the game closed the feed
+        if (got > 0) {
+            frames++;
+            spectate_board_view(&view, &board);
+            if (record) {
+                if (record_frame(record, &view, &board) < 0) break;
+            } else {
+                draw_board(&board, DRAW_SPECTATE);
+                refresh_screen();
+            }
+        }
+        if (record) pause_ms(refresh_ms);
+        else if (wait_input(refresh_ms) == 'Q') break;
+    }
+
+    if (record) fclose(record);
+    else terminal_cleanup();
+    printf("%ld frames seen (last %llu), %ld copies retried\n", frames, (unsigned long long)view.frame, view.retries);
+    spectate_detach(&view);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,274 @@
+#include "swarm.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Command codes of the arrays, chosen so the directions are 0-3
+enum {
+    CODE_W, CODE_S, CODE_A, CODE_D,
+    CODE_R,     // random direction
+    CODE_SLOW,  // 'C', 'T' or anything while charged: done by move_ghost
+    CODE_NONE   // ghost without a script, never moves
+};
+
+// The arrays are padded to a multiple of this many ghosts, so plan has no remainder loop
+// (gcc at -O2 only vectorizes loops whose trip count is a multiple of the vector width)
+#define SWARM_LANES 8
+#define PADDED(n) (((n) + SWARM_LANES - 1) & ~(SWARM_LANES - 1))
+
+// Values of 'target' that are not a cell
+#define TARGET_IDLE  -1     // waiting for its 'passo'
+#define TARGET_STEP  -2     // a move that goes nowhere (off the board), the script still advances
+#define TARGET_SLOW  -3     // left to move_ghost
+
+struct swarm {
+    board_t* board;
+    int n;
+    // hot data, one entry per ghost
+    int32_t* x;
+    int32_t* y;
+    int32_t* waiting;
+    int32_t* passo;
+    int32_t* cmd;           // code of the command at 'step'
+    int32_t* target;        // cell the ghost tries to enter this tick, or a TARGET_ value
+    uint32_t* rng;          // xorshift32 state for 'R'
+    int32_t* step;          // current_move
+    uint8_t* charged;
+    // scripts as codes, MAX_MOVES per ghost, and their lengths
+    uint8_t* script;
+    uint8_t* n_moves;
+
+    uint8_t* claims;        // ghosts targeting each cell this tick (saturates at 2), zero between ticks
+    int* conflicts;
+    int n_conflicts;
+};
+
+static int32_t code_of(char command, int charged) {
+    if (charged) return CODE_SLOW;
+    switch (command) {
+        case 'W': return CODE_W;
+        case 'S': return CODE_S;
+        case 'A': return CODE_A;
+        case 'D': return CODE_D;
+        case 'R': return CODE_R;
+        default: return CODE_SLOW;
+    }
+}
+
+// Code of the command ghost 'i' is at now
+static int32_t current_code(swarm_t* s, int i) {
+    if (s->n_moves[i] == 0) return CODE_NONE;
+    return s->charged[i] ? CODE_SLOW : s->script[i * MAX_MOVES + s->step[i] % s->n_moves[i]];
+}
+
+swarm_t* swarm_create(board_t* board) {
+    if (board->n_delta_hooks > 0) return NULL;
+    swarm_t* s = calloc(1, sizeof(swarm_t));
+    if (!s) return NULL;
+    int n = board->n_ghosts;
+    size_t slots = PADDED(n > 0 ? n : 1);
+    s->board = board;
+    s->n = n;
+    s->x = malloc(slots * sizeof(int32_t));
+    s->y = malloc(slots * sizeof(int32_t));
+    s->waiting = malloc(slots * sizeof(int32_t));
+    s->passo = malloc(slots * sizeof(int32_t));
+    s->cmd = malloc(slots * sizeof(int32_t));
+    s->target = malloc(slots * sizeof(int32_t));
+    s->rng = malloc(slots * sizeof(uint32_t));
+    s->step = malloc(slots * sizeof(int32_t));
+    s->charged = malloc(slots);
+    s->script = malloc(slots * MAX_MOVES);
+    s->n_moves = malloc(slots);
+    s->claims = calloc((size_t)board->width * board->height, 1);
+    s->conflicts = malloc(slots * sizeof(int));
+    if (!s->x || !s->y || !s->waiting || !s->passo || !s->cmd || !s->target || !s->rng || !s->step ||
+        !s->charged || !s->script || !s->n_moves || !s->claims || !s->conflicts) {
+        s->n = 0;   // nothing to store back
+        swarm_destroy(s);
+        return NULL;
+    }
+
+    // Padding ghosts have no script and never move
+    for (size_t i = n; i < slots; i++) {
+        s->x[i] = s->y[i] = s->waiting[i] = s->passo[i] = 0;
+        s->cmd[i] = CODE_NONE;
+        s->rng[i] = 1;
+    }
+    for (int i = 0; i < n; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        s->x[i] = ghost->pos_x;
+        s->y[i] = ghost->pos_y;
+        s->waiting[i] = ghost->waiting;
+        s->passo[i] = ghost->passo;
+        s->step[i] = ghost->current_move;
+        s->charged[i] = (uint8_t)ghost->charged;
+        s->n_moves[i] = (uint8_t)ghost->n_moves;
+        for (int k = 0; k < ghost->n_moves; k++) {
+            s->script[i * MAX_MOVES + k] = (uint8_t)code_of(ghost->moves[k].command, 0);
+        }
+        s->cmd[i] = current_code(s, i);
+        s->rng[i] = ghost->rng ? ghost->rng : 1;
+    }
+    return s;
+}
+
+// Pass 1: timers, random directions and targets, no branches so it vectorizes. The arrays come
+// in as restrict parameters: gcc ignores restrict on local copies and would not vectorize
+static void plan(int n, int32_t width, int32_t height, const int32_t* restrict x, const int32_t* restrict y,
+                 const int32_t* restrict passo, const int32_t* restrict cmd, int32_t* restrict waiting,
+                 int32_t* restrict target, uint32_t* restrict rng) {
+    for (int i = 0; i < PADDED(n); i++) {
+        // every load up front: a load under a condition stops the vectorizer
+        int32_t wait = waiting[i], reset = passo[i], code = cmd[i];
+        int32_t px = x[i], py = y[i];
+        uint32_t r = rng[i];
+
+        // conditions as all-ones/zero masks, which map straight onto vector compares
+        int32_t go = wait == 0 ? -1 : 0;
+        waiting[i] = go ? reset : wait - 1;
+
+        uint32_t next = r ^ (r << 13);
+        next ^= next >> 17;
+        next ^= next << 5;
+        int32_t random = go & (code == CODE_R ? -1 : 0);
+        rng[i] = r ^ ((next ^ r) & (uint32_t)random);
+
+        int32_t dir = code ^ (((int32_t)(next >> 30) ^ code) & random);
+        int32_t nx = px + (dir == CODE_D ? 1 : 0) - (dir == CODE_A ? 1 : 0);
+        int32_t ny = py + (dir == CODE_S ? 1 : 0) - (dir == CODE_W ? 1 : 0);
+        int32_t inside = (nx >= 0 ? -1 : 0) & (nx < width ? -1 : 0) & (ny >= 0 ? -1 : 0) & (ny < height ? -1 : 0);
+        int32_t walks = dir < CODE_R ? -1 : 0;
+        int32_t t = walks & inside ? ny * width + nx : TARGET_STEP;
+        t = code == CODE_SLOW ? TARGET_SLOW : t;
+        t = code == CODE_NONE ? TARGET_IDLE : t;
+        target[i] = go ? t : TARGET_IDLE;
+    }
+}
+
+// Moves ghost 'i' to cell 't' (its cell lock is not taken: the swarm is the only writer)
+static void place(swarm_t* s, int i, int32_t t) {
+    board_t* board = s->board;
+    board->cells[s->y[i] * board->width + s->x[i]] = ' ';
+    board->cells[t] = 'M';
+    s->x[i] = t % board->width;
+    s->y[i] = t / board->width;
+}
+
+// A conflict, by the rules of step_ghost on the board as the earlier ghosts left it.
+// Returns 1 if the ghost changed cell
+static int resolve(swarm_t* s, int i) {
+    board_t* board = s->board;
+    if (s->target[i] == TARGET_SLOW) {
+        ghost_t* ghost = &board->ghosts[i];
+        ghost->pos_x = s->x[i];
+        ghost->pos_y = s->y[i];
+        ghost->current_move = s->step[i];
+        ghost->charged = s->charged[i];
+        ghost->waiting = 0;     // plan already ran the timer
+        ghost->rng = s->rng[i];
+        move_ghost(board, i, &ghost->moves[ghost->current_move % ghost->n_moves]);
+        s->rng[i] = ghost->rng;
+        int moved = ghost->pos_x != s->x[i] || ghost->pos_y != s->y[i];
+        s->x[i] = ghost->pos_x;
+        s->y[i] = ghost->pos_y;
+        s->step[i] = ghost->current_move;
+        s->charged[i] = (uint8_t)ghost->charged;
+        s->waiting[i] = ghost->waiting;
+        s->cmd[i] = current_code(s, i);
+        return moved;
+    }
+
+    int32_t t = s->target[i];
+    char content = board->cells[t];
+    if (content == 'W' || content == 'M') return 0;
+    if (content == 'P') {
+        for (int p = 0; p < board->n_pacmans; p++) {
+            pacman_t* pac = &board->pacmans[p];
+            if (pac->pos_y * board->width + pac->pos_x == t && atomic_load(&pac->alive)) {
+                kill_pacman(board, p);
+                break;
+            }
+        }
+    }
+    place(s, i, t);
+    return 1;
+}
+
+int swarm_tick(swarm_t* s, char key) {
+    board_t* board = s->board;
+    char keys[MAX_PACMANS] = { key };
+    board_tick_pacmans(board, keys);
+    if (!game_is_running(board)) return 0;
+
+    plan(s->n, board->width, board->height, s->x, s->y, s->passo, s->cmd, s->waiting, s->target, s->rng);
+
+    // Pass 2: claims per target cell
+    for (int i = 0; i < s->n; i++) {
+        int32_t t = s->target[i];
+        if (t >= 0 && s->claims[t] < 2) s->claims[t]++;
+    }
+
+    // Pass 3: the uncontested moves in index order, collecting the rest
+    int moved = 0;
+    s->n_conflicts = 0;
+    for (int i = 0; i < s->n; i++) {
+        int32_t t = s->target[i];
+        if (t == TARGET_IDLE) continue;
+        if (t == TARGET_SLOW) {
+            s->conflicts[s->n_conflicts++] = i;
+            continue;
+        }
+        s->step[i]++;
+        s->cmd[i] = current_code(s, i);
+        if (t == TARGET_STEP) continue;
+        char content = board->cells[t];
+        if (content == 'W') continue;
+        if (content == ' ' && s->claims[t] == 1) {
+            place(s, i, t);
+            moved++;
+        } else {
+            s->conflicts[s->n_conflicts++] = i;
+        }
+    }
+    for (int i = 0; i < s->n; i++) {
+        if (s->target[i] >= 0) s->claims[s->target[i]] = 0;
+    }
+
+    // Conflicts one at a time, until the round ends like board_tick does
+    for (int c = 0; c < s->n_conflicts && game_is_running(board); c++) {
+        moved += resolve(s, s->conflicts[c]);
+    }
+    atomic_fetch_add_explicit(&board->version, 1, memory_order_release);
+    return moved;
+}
+
+void swarm_store(swarm_t* s) {
+    for (int i = 0; i < s->n; i++) {
+        ghost_t* ghost = &s->board->ghosts[i];
+        ghost->pos_x = s->x[i];
+        ghost->pos_y = s->y[i];
+        ghost->waiting = s->waiting[i];
+        ghost->current_move = s->step[i];
+        ghost->charged = s->charged[i];
+        ghost->rng = s->rng[i];
+    }
+}
+
+void swarm_destroy(swarm_t* s) {
+    if (!s) return;
+    swarm_store(s);
+    free(s->x);
+    free(s->y);
+    free(s->waiting);
+    free(s->passo);
+    free(s->cmd);
+    free(s->target);
+    free(s->rng);
+    free(s->step);
+    free(s->charged);
+    free(s->script);
+    free(s->n_moves);
+    free(s->claims);
+    free(s->conflicts);
+    free(s);
+}
@@ -0,0 +1,223 @@
+#include "tiles.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define N_COLOURS 4
+
+typedef struct {
+    tile_sim_t* sim;
+    int id;
+} tile_worker_t;
+
+static int tile_of(tile_sim_t* sim, int x, int y) {
+    return (y / sim->tile_size) * sim->tiles_x + x / sim->tile_size;
+}
+
+static int colour_of(tile_sim_t* sim, int tile) {
+    return (tile % sim->tiles_x & 1) | ((tile / sim->tiles_x & 1) << 1);
+}
+
+static int add_member(tile_t* tile, int ghost) {
+    if (tile->n_members == tile->cap_members) {
+        int cap = tile->cap_members ? tile->cap_members * 2 : 8;
+        int* members = realloc(tile->members, cap * sizeof(int));
+        if (!members) return -1;
+        tile->members = members;
+        tile->cap_members = cap;
+    }
+    tile->members[tile->n_members++] = ghost;
+    return 0;
+}
+
+// Lock-free push of 'ghost' on a stack linked through sim->next
+static void push(tile_sim_t* sim, atomic_int* head, int ghost) {
+    int old = atomic_load_explicit(head, memory_order_relaxed);
+    do {
+        sim->next[ghost] = old;
+    } while (!atomic_compare_exchange_weak_explicit(head, &old, ghost, memory_order_release, memory_order_relaxed));
+}
+
+// Steps every ghost of one tile, handing the ones that leave it to their new tile
+static void step_tile(tile_sim_t* sim, int t) {
+    board_t* board = sim->board;
+    tile_t* tile = &sim->tiles[t];
+    int i = 0;
+    while (i < tile->n_members && game_is_running(board)) {
+        int g = tile->members[i];
+        ghost_t* ghost = &board->ghosts[g];
+        if (ghost->charged) {
+            tile->members[i] = tile->members[--tile->n_members];
+            push(sim, &sim->deferred, g);
+            continue;
+        }
+        move_ghost(board, g, &ghost->moves[ghost->current_move % ghost->n_moves]);
+        int dest = tile_of(sim, ghost->pos_x, ghost->pos_y);
+        if (dest != t) {
+            tile->members[i] = tile->members[--tile->n_members];
+            push(sim, &sim->tiles[dest].inbox, g);
+            continue;
+        }
+        i++;
+    }
+}
+
+// Moves the charged ghosts one at a time; their slide can cross any number of tiles
+static void run_deferred(tile_sim_t* sim) {
+    board_t* board = sim->board;
+    int g = atomic_exchange_explicit(&sim->deferred, -1, memory_order_acquire);
+    while (g >= 0) {
+        int next = sim->next[g];
+        ghost_t* ghost = &board->ghosts[g];
+        if (game_is_running(board)) {
+            move_ghost(board, g, &ghost->moves[ghost->current_move % ghost->n_moves]);
+        }
+        push(sim, &sim->tiles[tile_of(sim, ghost->pos_x, ghost->pos_y)].inbox, g);
+        g = next;
+    }
+}
+
+static void merge_inbox(tile_sim_t* sim, int t) {
+    tile_t* tile = &sim->tiles[t];
+    int g = atomic_exchange_explicit(&tile->inbox, -1, memory_order_acquire);
+    while (g >= 0) {
+        add_member(tile, g);
+        g = sim->next[g];
+    }
+}
+
+// The ghost part of a tick as seen by worker 'id'; every worker runs it between two barriers
+static void ghost_phases(tile_sim_t* sim, int id) {
+    for (int c = 0; c < N_COLOURS; c++) {
+        int n = sim->worker_counts[id * N_COLOURS + c];
+        int* tiles = sim->worker_tiles[id * N_COLOURS + c];
+        for (int i = 0; i < n; i++) step_tile(sim, tiles[i]);
+        pthread_barrier_wait(&sim->barrier);
+    }
+    if (id == 0) run_deferred(sim);
+    pthread_barrier_wait(&sim->barrier);
+    for (int i = 0; i < sim->worker_owned_counts[id]; i++) merge_inbox(sim, sim->worker_owned[id][i]);
+    pthread_barrier_wait(&sim->barrier);
+}
+
+static void* worker_task(void* arg) {
+    tile_worker_t* w = (tile_worker_t*)arg;
+    tile_sim_t* sim = w->sim;
+    int id = w->id;
+    free(w);
+    while (1) {
+        pthread_barrier_wait(&sim->barrier);   // tick start (or stop)
+        if (atomic_load(&sim->stop)) break;
+        ghost_phases(sim, id);
+    }
+    return NULL;
+}
+
+tile_sim_t* tiles_create(board_t* board, int tile_size, int workers) {
+    if (tile_size == 0) tile_size = DEFAULT_TILE_SIZE;
+    if (tile_size < 2 || workers < 1) return NULL;
+    tile_sim_t* sim = calloc(1, sizeof(tile_sim_t));
+    if (!sim) return NULL;
+    sim->board = board;
+    sim->tile_size = tile_size;
+    sim->tiles_x = (board->width + tile_size - 1) / tile_size;
+    sim->tiles_y = (board->height + tile_size - 1) / tile_size;
+    sim->n_workers = workers;
+    int n_tiles = sim->tiles_x * sim->tiles_y;
+    sim->tiles = calloc(n_tiles, sizeof(tile_t));
+    sim->next = malloc((board->n_ghosts > 0 ? board->n_ghosts : 1) * sizeof(int));
+    sim->worker_tiles = calloc(workers * N_COLOURS, sizeof(int*));
+    sim->worker_counts = calloc(workers * N_COLOURS, sizeof(int));
+    sim->worker_owned = calloc(workers, sizeof(int*));
+    sim->worker_owned_counts = calloc(workers, sizeof(int));
+    sim->tids = calloc(workers, sizeof(pthread_t));
+    if (!sim->tiles || !sim->next || !sim->worker_tiles || !sim->worker_counts || !sim->worker_owned ||
+        !sim->worker_owned_counts || !sim->tids) {
+        tiles_destroy(sim);
+        return NULL;
+    }
+    atomic_init(&sim->deferred, -1);
+
+    // Tiles of each colour are dealt round robin, so every worker gets a share of every phase
+    int dealt[N_COLOURS] = { 0 };
+    for (int t = 0; t < n_tiles; t++) {
+        atomic_init(&sim->tiles[t].inbox, -1);
+        int c = colour_of(sim, t);
+        int w = dealt[c]++ % workers;
+        int* list = realloc(sim->worker_tiles[w * N_COLOURS + c], (sim->worker_counts[w * N_COLOURS + c] + 1) * sizeof(int));
+        int* owned = realloc(sim->worker_owned[w], (sim->worker_owned_counts[w] + 1) * sizeof(int));
+        if (list) sim->worker_tiles[w * N_COLOURS + c] = list;
+        if (owned) sim->worker_owned[w] = owned;
+        if (!list || !owned) {
+            tiles_destroy(sim);
+            return NULL;
+        }
+        list[sim->worker_counts[w * N_COLOURS + c]++] = t;
+        owned[sim->worker_owned_counts[w]++] = t;
+    }
+    for (int g = 0; g < board->n_ghosts; g++) {
+        ghost_t* ghost = &board->ghosts[g];
+        if (add_member(&sim->tiles[tile_of(sim, ghost->pos_x, ghost->pos_y)], g) < 0) {
+            tiles_destroy(sim);
+            return NULL;
+        }
+    }
+
+    board->tile_owned = 1;
+    pthread_barrier_init(&sim->barrier, NULL, workers);
+    for (int i = 1; i < workers; i++) {
+        tile_worker_t* w = malloc(sizeof(tile_worker_t));
+        w->sim = sim;
+        w->id = i;
+        pthread_create(&sim->tids[i], NULL, worker_task, w);
+    }
+    return sim;
+}
+
+void tiles_tick(tile_sim_t* sim, char key) {
+    board_t* board = sim->board;
+    char keys[MAX_PACMANS] = { key };
+    board_tick_pacmans(board, keys);
+
+    if (game_is_running(board)) {
+        pthread_barrier_wait(&sim->barrier);
+        ghost_phases(sim, 0);
+    }
+    atomic_fetch_add_explicit(&board->version, 1, memory_order_release);
+}
+
+long tiles_run(tile_sim_t* sim, long ticks) {
+    long done = 0;
+    while (done < ticks && game_is_running(sim->board)) {
+        tiles_tick(sim, '\0');
+        done++;
+    }
+    return done;
+}
+
+void tiles_destroy(tile_sim_t* sim) {
+    if (!sim) return;
+    if (sim->board->tile_owned) {
+        atomic_store(&sim->stop, 1);
+        pthread_barrier_wait(&sim->barrier);
+        for (int i = 1; i < sim->n_workers; i++) pthread_join(sim->tids[i], NULL);
+        pthread_barrier_destroy(&sim->barrier);
+        sim->board->tile_owned = 0;
+    }
+    if (sim->tiles) {
+        for (int t = 0; t < sim->tiles_x * sim->tiles_y; t++) free(sim->tiles[t].members);
+    }
+    if (sim->worker_tiles) {
+        for (int i = 0; i < sim->n_workers * N_COLOURS; i++) free(sim->worker_tiles[i]);
+    }
+    if (sim->worker_owned) {
+        for (int i = 0; i < sim->n_workers; i++) free(sim->worker_owned[i]);
+    }
+    free(sim->tiles);
+    free(sim->next);
+    free(sim->worker_tiles);
+    free(sim->worker_counts);
+    free(sim->worker_owned);
+    free(sim->worker_owned_counts);
+    free(sim->tids);
+    free(sim);
+}
@@ -0,0 +1,156 @@
+#include "trace.h"
+#include "input_queue.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct trace_chunk {
+    trace_event_t events[TRACE_CHUNK_EVENTS];
+    struct trace_chunk* next;
+} trace_chunk_t;
+
+/*Events of one thread. Only its thread appends; buffers are linked into a global list when
+created and stay there after the thread exits, until trace_write*/
+typedef struct trace_buffer {
+    uint32_t tid;
+    char name[32];
+    trace_chunk_t* head;
+    trace_chunk_t* tail;
+    int used;               // events in 'tail'
+    long total;
+    long dropped;
+    struct trace_buffer* next;
+} trace_buffer_t;
+
+atomic_int trace_enabled;
+
+static char trace_path[512];
+static uint64_t epoch_ns, epoch_ticks;  // both clocks when tracing started
+static trace_buffer_t* buffers;         // guarded by buffers_mutex
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_tid;               // guarded by buffers_mutex
+static atomic_uint generation;          // bumped by trace_write when it frees the buffers
+
+static _Thread_local trace_buffer_t* my_buffer;
+static _Thread_local unsigned my_generation;   // generation 'my_buffer' belongs to
+
+// Buffer of the calling thread, registered on its first event of each generation: after
+// trace_write the old one is freed, so a later trace_start gets the thread a new one
+static trace_buffer_t* thread_buffer() {
+    unsigned current = atomic_load_explicit(&generation, memory_order_acquire);
+    if (my_buffer && my_generation == current) return my_buffer;
+    trace_buffer_t* buf = calloc(1, sizeof(trace_buffer_t));
+    if (!buf) return NULL;
+
+    pthread_mutex_lock(&buffers_mutex);
+    buf->tid = ++next_tid;
+    snprintf(buf->name, sizeof(buf->name), "thread %u", buf->tid);
+    buf->next = buffers;
+    buffers = buf;
+    pthread_mutex_unlock(&buffers_mutex);
+
+    my_buffer = buf;
+    my_generation = current;
+    return buf;
+}
+
+void trace_start(const char* path) {
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+    epoch_ns = now_ns();
+    epoch_ticks = trace_clock();
+    atomic_store(&trace_enabled, 1);
+}
+
+void trace_end(const char* name, uint64_t start, int arg) {
+    if (start == 0) return;
+    uint64_t end = trace_clock();
+    trace_buffer_t* buf = thread_buffer();
+    if (!buf) return;
+
+    if (buf->total >= TRACE_MAX_EVENTS) {
+        buf->dropped++;
+        return;
+    }
+    if (!buf->tail || buf->used == TRACE_CHUNK_EVENTS) {
+        trace_chunk_t* chunk = malloc(sizeof(trace_chunk_t));
+        if (!chunk) {
+            buf->dropped++;
+            return;
+        }
+        chunk->next = NULL;
+        if (buf->tail) buf->tail->next = chunk;
+        else buf->head = chunk;
+        buf->tail = chunk;
+        buf->used = 0;
+    }
+
+    trace_event_t* ev = &buf->tail->events[buf->used++];
+    ev->name = name;
+    ev->start = start;
+    ev->dur = end - start;
+    ev->arg = arg;
+    buf->total++;
+}
+
+void trace_thread_name(const char* name) {
+    if (!trace_on()) return;
+    trace_buffer_t* buf = thread_buffer();
+    if (buf) snprintf(buf->name, sizeof(buf->name), "%s", name);
+}
+
+static double us_per_tick;     // set by trace_write from both clocks over the whole run
+
+// Microseconds since trace_start, the unit of "ts"
+static double trace_us(uint64_t ticks) {
+    return ticks > epoch_ticks ? (ticks - epoch_ticks) * us_per_tick : 0;
+}
+
+int trace_write() {
+    if (trace_path[0] == '\0') return -1;
+    atomic_store(&trace_enabled, 0);
+    uint64_t ticks = trace_clock() - epoch_ticks;
+    us_per_tick = ticks ? (now_ns() - epoch_ns) / 1e3 / ticks : 0;
+
+    FILE* f = fopen(trace_path, "w");
+    pthread_mutex_lock(&buffers_mutex);
+    trace_buffer_t* buf = buffers;
+    buffers = NULL;
+    atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+    pthread_mutex_unlock(&buffers_mutex);
+
+    if (f) fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int first = 1;
+    while (buf) {
+        if (f) {
+            fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buf->tid, buf->name);
+            first = 0;
+            if (buf->dropped > 0) {
+                fprintf(f, ",\n{\"ph\":\"i\",\"name\":\"%ld events dropped\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":0}",
+                        buf->dropped, buf->tid);
+            }
+        }
+        trace_chunk_t* chunk = buf->head;
+        while (chunk) {
+            int n = chunk == buf->tail ? buf->used : TRACE_CHUNK_EVENTS;
+            for (int i = 0; f && i < n; i++) {
+                trace_event_t* ev = &chunk->events[i];
+                fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                        ev->name, buf->tid, trace_us(ev->start), ev->dur * us_per_tick);
+                if (ev->arg >= 0) fprintf(f, ",\"args\":{\"id\":%d}", ev->arg);
+                fputc('}', f);
+            }
+            trace_chunk_t* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        trace_buffer_t* next = buf->next;
+        free(buf);
+        buf = next;
+    }
+    if (!f) return -1;
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 0;
+}